@@ -0,0 +1,272 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+namespace {
+constexpr std::size_t mib = std::size_t{1} << 20;
+
+// A synthetic corpus whose entropy is determined by the size of the vocabulary it is drawn from.
+struct Corpus {
+  std::string name;
+  std::string data;
+  std::filesystem::path xz_path;
+  std::size_t xz_size{};
+};
+
+std::string generate(std::string_view entropy, std::size_t size, std::mt19937_64& rng) {
+  std::string out{};
+  out.reserve(size);
+  if (entropy == "high") {
+    std::uniform_int_distribution<int> dist{0, 255};
+    while (out.size() < size) {
+      out.push_back(static_cast<char>(dist(rng)));
+    }
+    return out;
+  }
+
+  // Words of random letters, drawn from a small vocabulary for low and a large one for medium
+  // entropy, separated by spaces and newlines.
+  const std::size_t vocab_size = entropy == "low" ? 64 : 16384;
+  std::uniform_int_distribution<std::size_t> len_dist{2, 10};
+  std::uniform_int_distribution<int> letter_dist{'a', 'z'};
+  std::vector<std::string> vocab(vocab_size);
+  for (auto& word : vocab) {
+    word.resize(len_dist(rng));
+    std::ranges::generate(word, [&] { return static_cast<char>(letter_dist(rng)); });
+  }
+  std::uniform_int_distribution<std::size_t> word_dist{0, vocab_size - 1};
+  std::uniform_int_distribution<int> sep_dist{0, 11};
+  while (out.size() < size) {
+    out += vocab[word_dist(rng)];
+    out.push_back(sep_dist(rng) == 0 ? '\n' : ' ');
+  }
+  out.resize(size);
+  return out;
+}
+
+// The median duration of the given number of runs in seconds.
+template<typename TFun>
+double measure(std::size_t reps, TFun&& fun) {
+  std::vector<double> times(reps);
+  for (auto& time : times) {
+    const auto begin = std::chrono::steady_clock::now();
+    fun();
+    time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  }
+  std::ranges::sort(times);
+  return times[reps / 2];
+}
+
+double mib_per_s(std::size_t bytes, double seconds) {
+  return static_cast<double>(bytes) / static_cast<double>(mib) / seconds;
+}
+
+struct Benchmark {
+  std::filesystem::path dir;
+  bool quick;
+  std::vector<std::string> results{};
+
+  [[nodiscard]] std::size_t reps() const {
+    return quick ? 1 : 3;
+  }
+
+  void add(std::string_view name, const Corpus& corpus, std::string_view params, double seconds,
+           std::size_t bytes) {
+    results.push_back(fmt::format(
+      R"({{"benchmark": "{}", "corpus": "{}", {}"seconds": {:.6f}, "throughput_mib_s": {:.3f}}})",
+      name, corpus.name, params, seconds, mib_per_s(bytes, seconds)));
+  }
+
+  void bench_open(const Corpus& corpus) {
+    constexpr std::size_t open_reps = 11;
+    const auto parse = measure(open_reps, [&] { plazma::Reader reader{corpus.xz_path}; });
+    results.push_back(fmt::format(
+      R"({{"benchmark": "open", "corpus": "{}", "index_file": false, "seconds": {:.6f}}})",
+      corpus.name, parse));
+
+    plazma::create_index_file(corpus.xz_path);
+    const auto load = measure(open_reps, [&] {
+      plazma::Reader reader{corpus.xz_path, {.index_file = plazma::IndexFileMode::load}};
+    });
+    results.push_back(fmt::format(
+      R"({{"benchmark": "open", "corpus": "{}", "index_file": true, "seconds": {:.6f}}})",
+      corpus.name, load));
+  }
+
+  void bench_sequential(const Corpus& corpus, std::size_t thread_num) {
+    plazma::Reader reader{corpus.xz_path};
+    thes::FixedStdThreadPool pool(thread_num);
+    std::string out(corpus.data.size(), '\0');
+    const auto seconds =
+      measure(reps(), [&] { reader.load_segment(0, std::span{out.data(), out.size()}, pool); });
+    THES_ASSERT(out == corpus.data);
+    add("sequential", corpus, fmt::format(R"("threads": {}, )", thread_num), seconds, out.size());
+  }
+
+  // Loads ranges at random offsets, each thread using the same reader.
+  void bench_random(const Corpus& corpus, std::size_t thread_num) {
+    constexpr std::size_t range_size = 4096;
+    const std::size_t range_num = quick ? 64 : 256;
+    plazma::Reader reader{corpus.xz_path};
+    thes::FixedStdThreadPool pool(thread_num);
+    const auto seconds = measure(reps(), [&] {
+      pool.execute([&](std::size_t idx) {
+        std::mt19937_64 rng{idx};
+        std::uniform_int_distribution<std::size_t> dist{0, corpus.data.size() - range_size};
+        std::string out(range_size, '\0');
+        for (std::size_t i = 0; i < range_num; ++i) {
+          const auto off = dist(rng);
+          reader.load_segment(off, std::span{out.data(), out.size()});
+          THES_ASSERT(out == std::string_view{corpus.data}.substr(off, range_size));
+        }
+      });
+    });
+    const auto ops = thread_num * range_num;
+    add("random", corpus,
+        fmt::format(R"("threads": {}, "range_size": {}, "ops_per_s": {:.1f}, )", thread_num,
+                    range_size, static_cast<double>(ops) / seconds),
+        seconds, ops * range_size);
+  }
+
+  void bench_write(const Corpus& corpus, thes::u32 preset, thes::u64 block_size,
+                   thes::u32 thread_num) {
+    const auto path = dir / "write.xz";
+    const auto seconds = measure(reps(), [&] {
+      plazma::Writer writer{
+        path, {.preset = preset, .block_size = block_size, .thread_num = thread_num}};
+      writer.write(std::span{corpus.data.data(), corpus.data.size()});
+      writer.finish();
+    });
+    const auto xz_size = std::filesystem::file_size(path);
+    std::filesystem::remove(path);
+    add("write", corpus,
+        fmt::format(R"("preset": {}, "block_size": {}, "threads": {}, "ratio": {:.4f}, )", preset,
+                    block_size, thread_num,
+                    static_cast<double>(xz_size) / static_cast<double>(corpus.data.size())),
+        seconds, corpus.data.size());
+  }
+};
+
+std::vector<std::size_t> thread_nums() {
+  const std::size_t max = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  std::vector<std::size_t> out{};
+  for (std::size_t n = 1; n < max; n *= 2) {
+    out.push_back(n);
+  }
+  out.push_back(max);
+  return out;
+}
+} // namespace
+
+int main(int argc, const char* const* const argv) {
+  std::optional<std::filesystem::path> out_path{};
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "plazma-benchmark";
+  bool quick = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (arg == "--quick") {
+      quick = true;
+    } else if (arg == "--out" && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (arg == "--dir" && i + 1 < argc) {
+      dir = argv[++i];
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--quick] [--out <json_file>] [--dir <work_dir>]\n";
+      return 1;
+    }
+  }
+  std::filesystem::create_directories(dir);
+
+  Benchmark bench{.dir = dir, .quick = quick};
+  const auto threads = thread_nums();
+  const std::vector<std::size_t> sizes =
+    quick ? std::vector<std::size_t>{mib, 4 * mib} : std::vector<std::size_t>{4 * mib, 64 * mib};
+
+  std::vector<Corpus> corpora{};
+  std::mt19937_64 rng{42};
+  thes::FixedStdThreadPool pool(threads.back());
+  for (const std::string_view entropy : {"low", "medium", "high"}) {
+    for (const auto size : sizes) {
+      auto name = fmt::format("{}-{}MiB", entropy, size / mib);
+      Corpus corpus{
+        .name = name, .data = generate(entropy, size, rng), .xz_path = dir / (name + ".xz")};
+      {
+        plazma::BlockWriter writer{corpus.xz_path, pool, {.block_size = mib}};
+        writer.write(std::span{corpus.data.data(), corpus.data.size()});
+        writer.finish();
+      }
+      corpus.xz_size = std::filesystem::file_size(corpus.xz_path);
+      std::cerr << "generated " << corpus.name << '\n';
+      corpora.push_back(std::move(corpus));
+    }
+  }
+
+  for (const auto& corpus : corpora) {
+    std::cerr << "decoding " << corpus.name << '\n';
+    bench.bench_open(corpus);
+    for (const auto thread_num : threads) {
+      bench.bench_sequential(corpus, thread_num);
+      bench.bench_random(corpus, thread_num);
+    }
+  }
+
+  // Encoding is only measured on the smallest corpus of each entropy to bound the run time.
+  const std::array<thes::u32, 3> presets{0, 3, 6};
+  const std::array<thes::u64, 2> block_sizes{mib, 4 * mib};
+  for (std::size_t i = 0; i < corpora.size(); i += sizes.size()) {
+    std::cerr << "encoding " << corpora[i].name << '\n';
+    for (const auto preset : presets) {
+      for (const auto block_size : block_sizes) {
+        for (const auto thread_num : threads) {
+          bench.bench_write(corpora[i], preset, block_size, static_cast<thes::u32>(thread_num));
+        }
+      }
+    }
+  }
+
+  std::string json = fmt::format("{{\n  \"hardware_concurrency\": {},\n  \"corpora\": [\n",
+                                 std::thread::hardware_concurrency());
+  for (std::size_t i = 0; i < corpora.size(); ++i) {
+    json += fmt::format(R"(    {{"name": "{}", "size": {}, "compressed_size": {}}}{})",
+                        corpora[i].name, corpora[i].data.size(), corpora[i].xz_size,
+                        i + 1 < corpora.size() ? ",\n" : "\n");
+  }
+  json += "  ],\n  \"results\": [\n";
+  for (std::size_t i = 0; i < bench.results.size(); ++i) {
+    json += fmt::format("    {}{}", bench.results[i], i + 1 < bench.results.size() ? ",\n" : "\n");
+  }
+  json += "  ]\n}\n";
+
+  for (const auto& corpus : corpora) {
+    std::filesystem::remove(corpus.xz_path);
+    std::filesystem::remove(plazma::index_file_path(corpus.xz_path));
+  }
+
+  if (out_path.has_value()) {
+    std::ofstream{*out_path} << json;
+  } else {
+    std::cout << json;
+  }
+}
@@ -5,8 +5,16 @@
 #include "base/block.hpp"
 #include "base/defs.hpp"
 #include "base/exception.hpp"
+#include "base/file.hpp"
 #include "base/filters.hpp"
+#include "base/mapped-file.hpp"
+#include "base/parallel.hpp"
+#include "base/pool.hpp"
+#include "base/sink.hpp"
+#include "base/source.hpp"
+#include "base/stats.hpp"
 #include "base/stream.hpp"
+#include "base/uring.hpp"
 // IWYU pragma: end_exports
 
 #endif // INCLUDE_PLAZMA_BASE_HPP
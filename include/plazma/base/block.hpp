@@ -7,15 +7,27 @@
 #ifndef INCLUDE_PLAZMA_BASE_BLOCK_HPP
 #define INCLUDE_PLAZMA_BASE_BLOCK_HPP
 
+#include <cstddef>
+#include <optional>
+#include <span>
+
 #include <lzma.h>
 
 #include "thesauros/containers.hpp"
 
+#include "plazma/base/sink.hpp"
+#include "plazma/base/stream.hpp"
+
 namespace plazma {
+struct Decoder;
 struct Reader;
 
 struct Block {
   explicit Block(Reader& reader, lzma_index_iter it) : reader_(reader), it_(it) {}
+  // A block whose compressed data of size `csize()` has been fetched already, e.g. by a
+  // `BlockFetcher`, which is decoded from `data` instead of reading from the reader's source.
+  Block(Reader& reader, lzma_index_iter it, std::span<const std::byte> data)
+      : reader_(reader), it_(it), data_(data) {}
 
   [[nodiscard]] lzma_index_iter raw() const {
     return it_;
@@ -40,15 +52,53 @@ struct Block {
     return uoff() + usize();
   }
 
-  void decompress(thes::DynamicBuffer& scratch, thes::DynamicBuffer& out);
+  // Decompresses the block directly into `out`, whose size has to be `usize()`.
+  // The state of the decoder is reinitialized in place, which keeps its allocations.
+  void decompress(Decoder& decoder, std::span<std::byte> out);
+  void decompress(Decoder& decoder, thes::DynamicBuffer& out);
+  // Decompresses the part of the block starting at the block-relative offset `begin` into `out`.
+  // Decoding stops as soon as `out` is full and the preceding output is discarded in chunks,
+  // i.e. the cost depends on the end of the range instead of the size of the block.
+  // The integrity check of the block is only verified if the range extends to its end.
+  void decompress(Decoder& decoder, std::size_t begin, std::span<std::byte> out);
+  // Decompresses the block in chunks of at most `sink_chunk_size` bytes, which are written to
+  // `sink` without finishing it, i.e. the memory use does not depend on the size of the block.
+  void decompress(Decoder& decoder, SinkRef sink);
+  // Decodes the whole block into a reused buffer of at most `sink_chunk_size` bytes, discarding
+  // the output, which throws if the integrity check or the sizes given by the index do not match.
+  void verify(Decoder& decoder);
+  // The memory which liblzma requires to decode the block, which reads the Block Header.
+  [[nodiscard]] std::size_t memusage(thes::DynamicBuffer& scratch);
+
+  // The same as above, but with a decoder state which only lives for the duration of the call.
+  void decompress(thes::DynamicBuffer& scratch, std::span<std::byte> out);
+  void decompress(thes::DynamicBuffer& scratch, thes::DynamicBuffer& out) {
+    out.resize(usize());
+    decompress(scratch, std::span{out.data(), out.size()});
+  }
   void decompress(thes::DynamicBuffer& out) {
     thes::DynamicBuffer scratch{};
     decompress(scratch, out);
   }
+  void decompress(thes::DynamicBuffer& scratch, std::size_t begin, std::span<std::byte> out);
 
 private:
+  // Reads and decodes the Block Header into `block`, whose filters have to be set, and returns
+  // the whole compressed block if it is available without reading.
+  std::optional<std::span<const std::byte>> read_header(lzma_block& block,
+                                                        thes::DynamicBuffer& scratch);
+  static std::size_t filters_memusage(const lzma_block& block);
+  // With a decoder, the decode is admitted by its budget. If `buffer` is given, it is resized to
+  // `usize()` once the budget has admitted it as well, and used as the output instead of `out`.
+  template<typename TOnFull>
+  void decode(Stream& s, thes::DynamicBuffer& scratch, Decoder* decoder,
+              thes::DynamicBuffer* buffer, std::span<std::byte> out, TOnFull&& on_full);
+  void decode_range(Stream& s, thes::DynamicBuffer& scratch, Decoder* decoder, std::size_t begin,
+                    std::span<std::byte> out);
+
   Reader& reader_;
   lzma_index_iter it_;
+  std::span<const std::byte> data_{};
 };
 } // namespace plazma
 
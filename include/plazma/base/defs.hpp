@@ -15,6 +15,8 @@
 
 namespace plazma {
 inline constexpr std::size_t chunk_size = 4096;
+// The size of the chunks in which decompressed data is passed to a sink.
+inline constexpr std::size_t sink_chunk_size = std::size_t{1} << 20;
 }
 
 template<>
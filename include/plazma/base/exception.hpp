@@ -22,6 +22,12 @@ struct Exception : public std::exception {
 private:
   std::string message_;
 };
+
+// Thrown if compressed data is corrupt, unsupported, or inconsistent with the index, as opposed to
+// errors which are not caused by the data, e.g. failed reads or an exhausted memory budget.
+struct DataError : public Exception {
+  using Exception::Exception;
+};
 } // namespace plazma
 
 #endif // INCLUDE_PLAZMA_BASE_EXCEPTION_HPP
@@ -0,0 +1,170 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_BASE_FILE_HPP
+#define INCLUDE_PLAZMA_BASE_FILE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "thesauros/format.hpp"
+
+#include "plazma/base/exception.hpp"
+
+namespace plazma {
+// A file opened for positional reads, whose descriptor can also be used for asynchronous reads.
+struct File {
+  explicit File(const std::filesystem::path& path)
+      : fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+    if (fd_ == -1) {
+      throw Exception(fmt::format("Opening {} failed: {}", path.string(), std::strerror(errno)));
+    }
+
+    struct stat st{};
+    if (::fstat(fd_, &st) == -1) {
+      const int err = errno;
+      ::close(fd_);
+      throw Exception(fmt::format("Reading the size of {} failed: {}", path.string(),
+                                  std::strerror(err)));
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+  }
+  File(const File&) = delete;
+  File(File&& other) noexcept
+      : fd_(std::exchange(other.fd_, -1)), size_(std::exchange(other.size_, 0)) {}
+  File& operator=(const File&) = delete;
+  File& operator=(File&&) = delete;
+  ~File() {
+    if (fd_ != -1) {
+      ::close(fd_);
+    }
+  }
+
+  [[nodiscard]] int fd() const {
+    return fd_;
+  }
+  [[nodiscard]] std::size_t size() const {
+    return size_;
+  }
+
+  // Reads up to `out.size()` bytes at offset `off`, returning the number of bytes read.
+  std::size_t try_pread(std::span<std::byte> out, std::size_t off) const {
+    while (true) {
+      const auto ret = ::pread(fd_, out.data(), out.size(), static_cast<off_t>(off));
+      if (ret >= 0) {
+        return static_cast<std::size_t>(ret);
+      }
+      if (errno != EINTR) {
+        throw Exception(fmt::format("Reading failed: {}", std::strerror(errno)));
+      }
+    }
+  }
+
+private:
+  int fd_;
+  std::size_t size_{0};
+};
+
+// A file opened for writing at explicit offsets, which also supports truncating and syncing.
+struct OutputFile {
+  enum class Mode {
+    // Create the file or truncate an existing one.
+    truncate,
+    // Open an existing file as it is, which has to be writable.
+    update,
+  };
+
+  explicit OutputFile(const std::filesystem::path& path, Mode mode = Mode::truncate)
+      : fd_(::open(path.c_str(),
+                   mode == Mode::truncate ? O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC
+                                          : O_RDWR | O_CLOEXEC,
+                   0644)) {
+    if (fd_ == -1) {
+      throw Exception(fmt::format("Opening {} failed: {}", path.string(), std::strerror(errno)));
+    }
+  }
+  OutputFile(const OutputFile&) = delete;
+  OutputFile(OutputFile&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+  OutputFile& operator=(const OutputFile&) = delete;
+  OutputFile& operator=(OutputFile&&) = delete;
+  ~OutputFile() {
+    if (fd_ != -1) {
+      ::close(fd_);
+    }
+  }
+
+  [[nodiscard]] int fd() const {
+    return fd_;
+  }
+
+  // Writes all of `data` at offset `off`.
+  void pwrite(std::span<const std::byte> data, std::size_t off) const {
+    while (!data.empty()) {
+      const auto ret = ::pwrite(fd_, data.data(), data.size(), static_cast<off_t>(off));
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw Exception(fmt::format("Writing failed: {}", std::strerror(errno)));
+      }
+      data = data.subspan(static_cast<std::size_t>(ret));
+      off += static_cast<std::size_t>(ret);
+    }
+  }
+  // Reads exactly `out.size()` bytes at offset `off`, which requires `Mode::update`.
+  void pread(std::span<std::byte> out, std::size_t off) const {
+    while (!out.empty()) {
+      const auto ret = ::pread(fd_, out.data(), out.size(), static_cast<off_t>(off));
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ret <= 0) {
+        throw Exception(fmt::format("Reading {} bytes at offset {} failed!", out.size(), off));
+      }
+      out = out.subspan(static_cast<std::size_t>(ret));
+      off += static_cast<std::size_t>(ret);
+    }
+  }
+  void truncate(std::size_t size) const {
+    if (::ftruncate(fd_, static_cast<off_t>(size)) == -1) {
+      throw Exception(fmt::format("Truncating failed: {}", std::strerror(errno)));
+    }
+  }
+  // Waits until the data written so far is stored durably.
+  void sync() const {
+    if (::fsync(fd_) == -1) {
+      throw Exception(fmt::format("Syncing failed: {}", std::strerror(errno)));
+    }
+  }
+
+private:
+  int fd_;
+};
+
+// Stores the entries of the given directory durably, e.g. after a file has been renamed.
+inline void sync_directory(const std::filesystem::path& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    throw Exception(fmt::format("Opening {} failed: {}", path.string(), std::strerror(errno)));
+  }
+  const int ret = ::fsync(fd);
+  const int err = errno;
+  ::close(fd);
+  if (ret == -1) {
+    throw Exception(fmt::format("Syncing {} failed: {}", path.string(), std::strerror(err)));
+  }
+}
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_BASE_FILE_HPP
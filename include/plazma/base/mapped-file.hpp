@@ -0,0 +1,114 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_BASE_MAPPED_FILE_HPP
+#define INCLUDE_PLAZMA_BASE_MAPPED_FILE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "thesauros/format.hpp"
+
+#include "plazma/base/exception.hpp"
+
+namespace plazma {
+// The expected access pattern of a mapping, which is passed on to the kernel using madvise.
+enum class Access { normal, sequential, random };
+
+// A read-only memory mapping of a whole file.
+struct MappedFile {
+  explicit MappedFile(const std::filesystem::path& path, Access access = Access::normal) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      throw Exception(fmt::format("Opening {} failed: {}", path.string(), std::strerror(errno)));
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) == -1) {
+      const int err = errno;
+      ::close(fd);
+      throw Exception(fmt::format("Reading the size of {} failed: {}", path.string(),
+                                  std::strerror(err)));
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+
+    if (size_ > 0) {
+      void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        const int err = errno;
+        ::close(fd);
+        throw Exception(fmt::format("Mapping {} failed: {}", path.string(), std::strerror(err)));
+      }
+      data_ = static_cast<std::byte*>(data);
+    }
+    // The mapping stays valid after the descriptor is closed.
+    ::close(fd);
+
+    advise(access);
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile& operator=(MappedFile&&) = delete;
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      ::munmap(data_, size_);
+    }
+  }
+
+  [[nodiscard]] std::span<const std::byte> span() const {
+    return {data_, size_};
+  }
+  [[nodiscard]] std::span<const std::byte> subspan(std::size_t off, std::size_t size) const {
+    return span().subspan(off, size);
+  }
+  [[nodiscard]] std::size_t size() const {
+    return size_;
+  }
+
+  void advise(Access access) const {
+    if (data_ == nullptr) {
+      return;
+    }
+    const int advice = [&] {
+      switch (access) {
+        case Access::sequential: return MADV_SEQUENTIAL;
+        case Access::random: return MADV_RANDOM;
+        default: return MADV_NORMAL;
+      }
+    }();
+    // Advice is only a hint, so failures are not an error.
+    ::madvise(data_, size_, advice);
+  }
+
+  // Asks the kernel to read the given range ahead of its use.
+  void will_need(std::size_t off, std::size_t size) const {
+    if (data_ == nullptr) {
+      return;
+    }
+    // madvise requires a page-aligned start.
+    static const auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const auto begin = off / page_size * page_size;
+    ::madvise(data_ + begin, off + size - begin, MADV_WILLNEED);
+  }
+
+private:
+  std::byte* data_{nullptr};
+  std::size_t size_{0};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_BASE_MAPPED_FILE_HPP
@@ -0,0 +1,82 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_BASE_PARALLEL_HPP
+#define INCLUDE_PLAZMA_BASE_PARALLEL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+
+namespace plazma {
+// The indices in [0, size), which the threads of a pool claim in order.
+struct IndexQueue {
+  explicit IndexQueue(std::size_t size) : size_(size) {}
+
+  // The next unclaimed index, or std::nullopt if all indices have been claimed.
+  std::optional<std::size_t> claim() {
+    if (next_.load() >= size_) {
+      return std::nullopt;
+    }
+    const std::size_t i = next_++;
+    if (i >= size_) {
+      return std::nullopt;
+    }
+    return i;
+  }
+  // The number of indices which have not been claimed yet.
+  [[nodiscard]] std::size_t remaining() const {
+    const std::size_t claimed = next_.load();
+    return claimed < size_ ? size_ - claimed : 0;
+  }
+  // Stops claiming, i.e. the remaining indices are skipped.
+  void stop() {
+    next_ = size_;
+  }
+
+private:
+  std::size_t size_;
+  std::atomic<std::size_t> next_{0};
+};
+
+// Calls `fun(thread_idx, queue)` on each thread of the given pool, which claim the indices in
+// [0, size) from `queue`. Once a call throws, the remaining indices are skipped and the first
+// exception is rethrown after all threads are done.
+template<typename TPool, typename TFun>
+void parallel_execute(TPool& pool, std::size_t size, TFun&& fun) {
+  IndexQueue queue{size};
+  std::mutex error_mutex{};
+  std::exception_ptr error{};
+  pool.execute([&](std::size_t thread_idx) {
+    try {
+      fun(thread_idx, queue);
+    } catch (...) {
+      queue.stop();
+      std::lock_guard lock{error_mutex};
+      if (error == nullptr) {
+        error = std::current_exception();
+      }
+    }
+  });
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
+// Calls `fun(i)` for each index in [0, size) on the threads of the given pool.
+template<typename TPool, typename TFun>
+void parallel_for(TPool& pool, std::size_t size, TFun&& fun) {
+  parallel_execute(pool, size, [&](std::size_t /*thread_idx*/, IndexQueue& queue) {
+    while (const std::optional<std::size_t> i = queue.claim()) {
+      fun(*i);
+    }
+  });
+}
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_BASE_PARALLEL_HPP
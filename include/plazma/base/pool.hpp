@@ -0,0 +1,87 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_BASE_POOL_HPP
+#define INCLUDE_PLAZMA_BASE_POOL_HPP
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace plazma {
+// A thread-safe pool of objects, which allows the threads of a thread pool to reuse objects
+// which are expensive to create, such as decoders or fetchers.
+template<typename T>
+struct ObjectPool {
+  // An object which is returned to the pool on destruction.
+  struct Lease {
+    Lease(ObjectPool& pool, std::unique_ptr<T> object)
+        : pool_(&pool), object_(std::move(object)) {}
+    Lease(const Lease&) = delete;
+    Lease(Lease&& other) noexcept = default;
+    Lease& operator=(const Lease&) = delete;
+    Lease& operator=(Lease&&) = delete;
+    ~Lease() {
+      if (object_ != nullptr) {
+        pool_->release(std::move(object_));
+      }
+    }
+
+    T& operator*() const {
+      return *object_;
+    }
+    T* operator->() const {
+      return object_.get();
+    }
+
+  private:
+    ObjectPool* pool_;
+    std::unique_ptr<T> object_;
+  };
+
+  ObjectPool() = default;
+  ObjectPool(const ObjectPool&) = delete;
+  ObjectPool(ObjectPool&&) = delete;
+  ObjectPool& operator=(const ObjectPool&) = delete;
+  ObjectPool& operator=(ObjectPool&&) = delete;
+  ~ObjectPool() = default;
+
+  // Returns an unused object, creating one using `make()` if there is none.
+  template<typename TMake>
+  [[nodiscard]] Lease acquire(TMake&& make) {
+    std::unique_ptr<T> object{};
+    {
+      std::lock_guard lock{mutex_};
+      if (!free_.empty()) {
+        object = std::move(free_.back());
+        free_.pop_back();
+      }
+    }
+    if (object == nullptr) {
+      object = std::forward<TMake>(make)();
+    }
+    return {*this, std::move(object)};
+  }
+
+  // Destroys all unused objects.
+  void clear() {
+    std::lock_guard lock{mutex_};
+    free_.clear();
+  }
+
+private:
+  void release(std::unique_ptr<T> object) {
+    std::lock_guard lock{mutex_};
+    free_.push_back(std::move(object));
+  }
+
+  std::mutex mutex_{};
+  std::vector<std::unique_ptr<T>> free_{};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_BASE_POOL_HPP
@@ -0,0 +1,47 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_BASE_SINK_HPP
+#define INCLUDE_PLAZMA_BASE_SINK_HPP
+
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace plazma {
+// A sink consumes data in chunks of arbitrary size until it is finished.
+template<typename T>
+concept ByteSink = requires(T& sink, std::span<const std::byte> data) {
+  sink.write(data);
+  sink.finish();
+};
+
+// A non-owning, type-erased reference to a sink, which allows producers of chunked data to be
+// written without depending on the concrete sink type.
+struct SinkRef {
+  template<ByteSink TSink>
+  SinkRef(TSink& sink) // NOLINT(google-explicit-constructor)
+      : sink_(std::addressof(sink)),
+        write_([](void* s, std::span<const std::byte> data) {
+          static_cast<TSink*>(s)->write(data);
+        }),
+        finish_([](void* s) { static_cast<TSink*>(s)->finish(); }) {}
+
+  void write(std::span<const std::byte> data) const {
+    write_(sink_, data);
+  }
+  void finish() const {
+    finish_(sink_);
+  }
+
+private:
+  void* sink_;
+  void (*write_)(void*, std::span<const std::byte>);
+  void (*finish_)(void*);
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_BASE_SINK_HPP
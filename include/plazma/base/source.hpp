@@ -0,0 +1,146 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_BASE_SOURCE_HPP
+#define INCLUDE_PLAZMA_BASE_SOURCE_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include "thesauros/format.hpp"
+
+#include "plazma/base/exception.hpp"
+#include "plazma/base/file.hpp"
+#include "plazma/base/mapped-file.hpp"
+
+namespace plazma {
+// A source of data which supports positional reads, e.g. a shim for an object store.
+// `try_pread` reads up to `out.size()` bytes at offset `off` and returns the number of bytes read,
+// which may only be smaller at the end of the data. It has to be thread-safe if the reader using
+// the source is used from several threads.
+template<typename T>
+concept PreadSource = requires(T& source, std::span<std::byte> out, std::size_t off) {
+  { source.size() } -> std::convertible_to<std::size_t>;
+  { source.try_pread(out, off) } -> std::convertible_to<std::size_t>;
+};
+
+// The compressed data of a reader, which is either available in memory as a whole or read
+// positionally in chunks. Data in memory is decoded without any reads or copies.
+struct ByteSource {
+  // Data in memory, which has to outlive the source and all readers using it.
+  static ByteSource memory(std::span<const std::byte> data) {
+    ByteSource source{data.size()};
+    source.memory_ = data;
+    source.pread_ = [](const ByteSource& self, std::span<std::byte> out, std::size_t off) {
+      const auto mem = *self.memory_;
+      const auto num = off < mem.size() ? std::min(out.size(), mem.size() - off) : 0;
+      std::memcpy(out.data(), mem.data() + off, num);
+      return num;
+    };
+    return source;
+  }
+  // A file which is mapped into memory, i.e. which is also decoded without reads or copies.
+  static ByteSource mapped(MappedFile mapping) {
+    auto owner = std::make_shared<MappedFile>(std::move(mapping));
+    ByteSource source = memory(owner->span());
+    source.mapping_ = owner.get();
+    source.owner_ = std::move(owner);
+    return source;
+  }
+  // A file which is read using positional reads.
+  static ByteSource file(const std::filesystem::path& path) {
+    auto file = std::make_shared<File>(path);
+    ByteSource source = custom_impl(*file);
+    source.fd_ = file->fd();
+    source.owner_ = std::move(file);
+    return source;
+  }
+  // A user-defined source, which is owned by the returned object.
+  template<PreadSource T>
+  static ByteSource custom(T custom) {
+    auto owner = std::make_shared<T>(std::move(custom));
+    ByteSource source = custom_impl(*owner);
+    source.owner_ = std::move(owner);
+    return source;
+  }
+
+  ByteSource(const ByteSource&) = delete;
+  ByteSource(ByteSource&&) noexcept = default;
+  ByteSource& operator=(const ByteSource&) = delete;
+  ByteSource& operator=(ByteSource&&) noexcept = default;
+  ~ByteSource() = default;
+
+  [[nodiscard]] std::size_t size() const {
+    return size_;
+  }
+  // The whole data if it is available in memory, std::nullopt otherwise.
+  [[nodiscard]] std::optional<std::span<const std::byte>> memory() const {
+    return memory_;
+  }
+  // The mapping if the source is a mapped file, nullptr otherwise.
+  [[nodiscard]] const MappedFile* mapping() const {
+    return mapping_;
+  }
+  // The file descriptor if the source is a file which is read positionally, -1 otherwise.
+  [[nodiscard]] int fd() const {
+    return fd_;
+  }
+
+  [[nodiscard]] std::size_t try_pread(std::span<std::byte> out, std::size_t off) const {
+    return pread_(*this, out, off);
+  }
+  // Reads exactly `out.size()` bytes at offset `off`.
+  void pread(std::span<std::byte> out, std::size_t off) const {
+    while (!out.empty()) {
+      const auto num = try_pread(out, off);
+      if (num == 0) {
+        throw Exception(fmt::format("Reading {} bytes at offset {} failed, the size is {}!",
+                                    out.size(), off, size_));
+      }
+      out = out.subspan(num);
+      off += num;
+    }
+  }
+
+  // Hints that the given range is about to be read, which only has an effect for mappings.
+  void will_need(std::size_t off, std::size_t size) const {
+    if (mapping_ != nullptr) {
+      mapping_->will_need(off, size);
+    }
+  }
+
+private:
+  explicit ByteSource(std::size_t size) : size_(size) {}
+
+  template<PreadSource T>
+  static ByteSource custom_impl(T& impl) {
+    ByteSource source{static_cast<std::size_t>(impl.size())};
+    source.impl_ = &impl;
+    source.pread_ = [](const ByteSource& self, std::span<std::byte> out, std::size_t off) {
+      return static_cast<std::size_t>(static_cast<T*>(self.impl_)->try_pread(out, off));
+    };
+    return source;
+  }
+
+  std::size_t size_;
+  std::optional<std::span<const std::byte>> memory_{};
+  const MappedFile* mapping_{nullptr};
+  int fd_{-1};
+  // Keeps the mapping, the file, or the custom source alive, which `impl_` points to.
+  std::shared_ptr<void> owner_{};
+  void* impl_{nullptr};
+  std::size_t (*pread_)(const ByteSource&, std::span<std::byte>, std::size_t){nullptr};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_BASE_SOURCE_HPP
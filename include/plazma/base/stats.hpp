@@ -0,0 +1,217 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_BASE_STATS_HPP
+#define INCLUDE_PLAZMA_BASE_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+
+#include "thesauros/types.hpp"
+
+// Statistics are only recorded if this is defined to 1, e.g. by the `stats` Meson option.
+// Otherwise, the counters are empty and recording them does nothing.
+#ifndef PLAZMA_STATS
+#define PLAZMA_STATS 0
+#endif
+
+namespace plazma {
+inline constexpr bool stats_enabled = PLAZMA_STATS != 0;
+
+template<bool tEnabled>
+struct BasicCounter {
+  void add(thes::u64 value) {
+    value_.fetch_add(value, std::memory_order_relaxed);
+  }
+  [[nodiscard]] thes::u64 load() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<thes::u64> value_{0};
+};
+template<>
+struct BasicCounter<false> {
+  void add(thes::u64 /*value*/) {}
+  [[nodiscard]] thes::u64 load() const {
+    return 0;
+  }
+};
+using Counter = BasicCounter<stats_enabled>;
+
+// Measures the time since its construction.
+template<bool tEnabled>
+struct BasicStopwatch {
+  [[nodiscard]] thes::u64 ns() const {
+    return static_cast<thes::u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - begin_)
+                                    .count());
+  }
+
+private:
+  std::chrono::steady_clock::time_point begin_{std::chrono::steady_clock::now()};
+};
+template<>
+struct BasicStopwatch<false> {
+  [[nodiscard]] thes::u64 ns() const {
+    return 0;
+  }
+};
+using Stopwatch = BasicStopwatch<stats_enabled>;
+
+struct ReadStats {
+  thes::u64 pread_calls{};
+  thes::u64 pread_bytes{};
+  thes::u64 blocks_decoded{};
+  // The bytes produced by liblzma, including those which are discarded because they precede the
+  // requested range or have been decoded to verify the check of a block.
+  thes::u64 bytes_decompressed{};
+  // The bytes returned to the caller, which may exceed `bytes_decompressed` if blocks are cached.
+  thes::u64 bytes_delivered{};
+  thes::u64 code_ns{};
+};
+
+struct WriteStats {
+  thes::u64 bytes_in{};
+  thes::u64 bytes_out{};
+  // The time spent encoding, i.e. in liblzma or waiting for the threads encoding blocks.
+  thes::u64 encode_ns{};
+  // The number of writes to the file and the time spent in them.
+  thes::u64 writes{};
+  thes::u64 write_ns{};
+  // The number of times the caller waited for the encoder without passing it any input, e.g. for
+  // the threads encoding blocks to finish, and the time spent doing so.
+  thes::u64 stalls{};
+  thes::u64 stall_ns{};
+};
+
+// The counters of a reader, which also record into the global counters.
+struct ReadCounters {
+  // The counters of all readers.
+  static ReadCounters& global() {
+    static ReadCounters counters{};
+    return counters;
+  }
+
+  void pread(thes::u64 bytes) {
+    for_each([&](ReadCounters& c) {
+      c.pread_calls_.add(1);
+      c.pread_bytes_.add(bytes);
+    });
+  }
+  void block(thes::u64 bytes) {
+    for_each([&](ReadCounters& c) {
+      c.blocks_decoded_.add(1);
+      c.bytes_decompressed_.add(bytes);
+    });
+  }
+  void deliver(thes::u64 bytes) {
+    for_each([&](ReadCounters& c) { c.bytes_delivered_.add(bytes); });
+  }
+  void code(const Stopwatch& watch) {
+    for_each([&](ReadCounters& c) { c.code_ns_.add(watch.ns()); });
+  }
+
+  [[nodiscard]] ReadStats snapshot() const {
+    return {
+      .pread_calls = pread_calls_.load(),
+      .pread_bytes = pread_bytes_.load(),
+      .blocks_decoded = blocks_decoded_.load(),
+      .bytes_decompressed = bytes_decompressed_.load(),
+      .bytes_delivered = bytes_delivered_.load(),
+      .code_ns = code_ns_.load(),
+    };
+  }
+
+private:
+  template<typename TFun>
+  void for_each(TFun&& fun) {
+    if constexpr (stats_enabled) {
+      fun(*this);
+      if (ReadCounters& glob = global(); this != &glob) {
+        fun(glob);
+      }
+    }
+  }
+
+  [[no_unique_address]] Counter pread_calls_{};
+  [[no_unique_address]] Counter pread_bytes_{};
+  [[no_unique_address]] Counter blocks_decoded_{};
+  [[no_unique_address]] Counter bytes_decompressed_{};
+  [[no_unique_address]] Counter bytes_delivered_{};
+  [[no_unique_address]] Counter code_ns_{};
+};
+
+// The counters of a writer, which also record into the global counters.
+struct WriteCounters {
+  // The counters of all writers.
+  static WriteCounters& global() {
+    static WriteCounters counters{};
+    return counters;
+  }
+
+  void input(thes::u64 bytes) {
+    for_each([&](WriteCounters& c) { c.bytes_in_.add(bytes); });
+  }
+  void encode(const Stopwatch& watch) {
+    for_each([&](WriteCounters& c) { c.encode_ns_.add(watch.ns()); });
+  }
+  void output(thes::u64 bytes, const Stopwatch& watch) {
+    for_each([&](WriteCounters& c) {
+      c.bytes_out_.add(bytes);
+      c.writes_.add(1);
+      c.write_ns_.add(watch.ns());
+    });
+  }
+  void stall(const Stopwatch& watch) {
+    for_each([&](WriteCounters& c) {
+      c.stalls_.add(1);
+      c.stall_ns_.add(watch.ns());
+    });
+  }
+
+  [[nodiscard]] WriteStats snapshot() const {
+    return {
+      .bytes_in = bytes_in_.load(),
+      .bytes_out = bytes_out_.load(),
+      .encode_ns = encode_ns_.load(),
+      .writes = writes_.load(),
+      .write_ns = write_ns_.load(),
+      .stalls = stalls_.load(),
+      .stall_ns = stall_ns_.load(),
+    };
+  }
+
+private:
+  template<typename TFun>
+  void for_each(TFun&& fun) {
+    if constexpr (stats_enabled) {
+      fun(*this);
+      if (WriteCounters& glob = global(); this != &glob) {
+        fun(glob);
+      }
+    }
+  }
+
+  [[no_unique_address]] Counter bytes_in_{};
+  [[no_unique_address]] Counter bytes_out_{};
+  [[no_unique_address]] Counter encode_ns_{};
+  [[no_unique_address]] Counter writes_{};
+  [[no_unique_address]] Counter write_ns_{};
+  [[no_unique_address]] Counter stalls_{};
+  [[no_unique_address]] Counter stall_ns_{};
+};
+
+// Snapshots of the counters of all readers and writers, respectively.
+inline ReadStats global_read_stats() {
+  return ReadCounters::global().snapshot();
+}
+inline WriteStats global_write_stats() {
+  return WriteCounters::global().snapshot();
+}
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_BASE_STATS_HPP
@@ -20,6 +20,16 @@ struct Stream : public lzma_stream {
   ~Stream() {
     lzma_end(this);
   }
+
+  // Frees the internal state, after which the stream can be initialized again.
+  // The allocator is kept.
+  void reset() {
+    const lzma_allocator* alloc = allocator;
+    lzma_end(this);
+    lzma_stream init = LZMA_STREAM_INIT;
+    static_cast<lzma_stream&>(*this) = init;
+    allocator = alloc;
+  }
 };
 } // namespace plazma
 
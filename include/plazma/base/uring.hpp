@@ -0,0 +1,237 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_BASE_URING_HPP
+#define INCLUDE_PLAZMA_BASE_URING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "thesauros/format.hpp"
+
+#include "plazma/base/exception.hpp"
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PLAZMA_HAS_IO_URING 1
+#else
+#define PLAZMA_HAS_IO_URING 0
+#endif
+
+namespace plazma {
+// The completion of a read submitted to a `Uring`, whose result is the number of bytes read or
+// the negated error number.
+struct UringCompletion {
+  std::uint64_t user_data;
+  std::int32_t res;
+};
+
+#if PLAZMA_HAS_IO_URING
+// A minimal io_uring instance which only submits reads, using the system calls directly.
+// An instance must only be used by a single thread.
+struct Uring {
+  // Returns nullptr if io_uring is not supported, e.g. because the kernel is too old or the
+  // system calls are blocked, in which case the caller has to fall back to blocking reads.
+  static std::unique_ptr<Uring> create(unsigned entries) {
+    io_uring_params params{};
+    const auto fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return nullptr;
+    }
+    // IORING_OP_READ has been added in the same version as this feature.
+    if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+      ::close(fd);
+      return nullptr;
+    }
+    std::unique_ptr<Uring> ring{new Uring(fd, params)};
+    return ring->sq_ring_ == nullptr ? nullptr : std::move(ring);
+  }
+
+  Uring(const Uring&) = delete;
+  Uring(Uring&&) = delete;
+  Uring& operator=(const Uring&) = delete;
+  Uring& operator=(Uring&&) = delete;
+  ~Uring() {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    ::close(fd_);
+  }
+
+  // The number of reads which have been queued or submitted but not completed yet.
+  [[nodiscard]] std::size_t in_flight() const {
+    return queued_ + submitted_;
+  }
+
+  // Queues a read of `out` at offset `off`, returning false if the submission queue is full.
+  bool queue_read(int fd, std::span<std::byte> out, std::size_t off, std::uint64_t user_data) {
+    const unsigned tail = *sq_tail_;
+    if (tail - load(sq_head_) == sq_entries_) {
+      return false;
+    }
+    const unsigned idx = tail & sq_mask_;
+    io_uring_sqe& sqe = sqes_[idx];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(out.data());
+    sqe.len = static_cast<std::uint32_t>(out.size());
+    sqe.off = off;
+    sqe.user_data = user_data;
+    sq_array_[idx] = idx;
+    store(sq_tail_, tail + 1);
+    ++queued_;
+    return true;
+  }
+
+  // Submits all queued reads and waits for at least `min_complete` completions.
+  void submit(unsigned min_complete) {
+    while (true) {
+      const auto ret = ::syscall(__NR_io_uring_enter, fd_, queued_, min_complete,
+                                 min_complete > 0 ? IORING_ENTER_GETEVENTS : 0U, nullptr, 0);
+      if (ret >= 0) {
+        queued_ -= static_cast<unsigned>(ret);
+        submitted_ += static_cast<std::size_t>(ret);
+        if (queued_ == 0) {
+          return;
+        }
+        continue;
+      }
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        throw Exception(fmt::format("Submitting reads failed: {}", std::strerror(errno)));
+      }
+    }
+  }
+
+  // Moves the available completions into `out`, returning their number.
+  std::size_t reap(std::span<UringCompletion> out) {
+    unsigned head = *cq_head_;
+    const unsigned tail = load(cq_tail_);
+    std::size_t num = 0;
+    for (; head != tail && num < out.size(); ++head, ++num) {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      out[num] = {.user_data = cqe.user_data, .res = cqe.res};
+    }
+    store(cq_head_, head);
+    submitted_ -= num;
+    return num;
+  }
+
+private:
+  Uring(int fd, const io_uring_params& params) : fd_(fd), sq_entries_(params.sq_entries) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+    auto* sq_ring = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    auto* cq_ring = single_mmap ? sq_ring : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    auto* sqes = map(sqes_size_, IORING_OFF_SQES);
+    if (sq_ring == nullptr || cq_ring == nullptr || sqes == nullptr) {
+      if (sqes != nullptr) {
+        ::munmap(sqes, sqes_size_);
+      }
+      if (cq_ring != nullptr && cq_ring != sq_ring) {
+        ::munmap(cq_ring, cq_ring_size_);
+      }
+      if (sq_ring != nullptr) {
+        ::munmap(sq_ring, sq_ring_size_);
+      }
+      return;
+    }
+    sq_ring_ = sq_ring;
+    cq_ring_ = cq_ring;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sq_head_ = field<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = field<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_mask_ = *field<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_array_ = field<unsigned>(sq_ring_, params.sq_off.array);
+    cq_head_ = field<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = field<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *field<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = field<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+  }
+
+  void* map(std::size_t size, std::uint64_t off) const {
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                       static_cast<off_t>(off));
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+  template<typename T>
+  static T* field(void* ring, std::uint32_t off) {
+    return reinterpret_cast<T*>(static_cast<std::byte*>(ring) + off);
+  }
+  // The indices shared with the kernel are accessed with acquire and release semantics.
+  static unsigned load(unsigned* ptr) {
+    return std::atomic_ref<unsigned>{*ptr}.load(std::memory_order_acquire);
+  }
+  static void store(unsigned* ptr, unsigned value) {
+    std::atomic_ref<unsigned>{*ptr}.store(value, std::memory_order_release);
+  }
+
+  int fd_;
+  unsigned sq_entries_;
+  std::size_t sq_ring_size_{0};
+  std::size_t cq_ring_size_{0};
+  std::size_t sqes_size_{0};
+  void* sq_ring_{nullptr};
+  void* cq_ring_{nullptr};
+  io_uring_sqe* sqes_{nullptr};
+
+  unsigned* sq_head_{nullptr};
+  unsigned* sq_tail_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned* sq_array_{nullptr};
+  unsigned* cq_head_{nullptr};
+  unsigned* cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  io_uring_cqe* cqes_{nullptr};
+
+  unsigned queued_{0};
+  std::size_t submitted_{0};
+};
+#else
+// A stand-in on systems without io_uring, which is never available.
+struct Uring {
+  static std::unique_ptr<Uring> create(unsigned /*entries*/) {
+    return nullptr;
+  }
+  [[nodiscard]] std::size_t in_flight() const {
+    return 0;
+  }
+  bool queue_read(int /*fd*/, std::span<std::byte> /*out*/, std::size_t /*off*/,
+                  std::uint64_t /*user_data*/) {
+    return false;
+  }
+  void submit(unsigned /*min_complete*/) {}
+  std::size_t reap(std::span<UringCompletion> /*out*/) {
+    return 0;
+  }
+};
+#endif
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_BASE_URING_HPP
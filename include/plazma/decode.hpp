@@ -2,8 +2,16 @@
 #define INCLUDE_PLAZMA_DECODE_HPP
 
 // IWYU pragma: begin_exports
+#include "decode/block-stream.hpp"
 #include "decode/block.ipp"
+#include "decode/cache.hpp"
+#include "decode/dataset.hpp"
 #include "decode/decode.hpp"
+#include "decode/decoder.hpp"
+#include "decode/fetch.hpp"
+#include "decode/index-file.hpp"
+#include "decode/index.hpp"
+#include "decode/memory-budget.hpp"
 #include "decode/read-index.hpp"
 #include "decode/reader.hpp"
 // IWYU pragma: end_exports
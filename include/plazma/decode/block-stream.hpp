@@ -0,0 +1,271 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_DECODE_BLOCK_STREAM_HPP
+#define INCLUDE_PLAZMA_DECODE_BLOCK_STREAM_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <lzma.h>
+
+#include "thesauros/containers.hpp"
+#include "thesauros/format.hpp"
+
+#include "plazma/base.hpp"
+#include "plazma/decode/decoder.hpp"
+#include "plazma/decode/memory-budget.hpp"
+#include "plazma/decode/reader.hpp"
+
+namespace plazma {
+struct BlockStreamParams {
+  // The number of background threads, which defaults to the number of cores.
+  std::optional<std::size_t> thread_num{};
+  // The maximum number of blocks which are being decoded or waiting to be consumed,
+  // which defaults to twice the number of threads.
+  std::optional<std::size_t> window{};
+  // The uncompressed range [begin, end), of which only the overlapping blocks are decoded.
+  // These are returned in full, i.e. the first and last block may extend beyond the range.
+  std::size_t begin{0};
+  std::optional<std::size_t> end{};
+};
+
+// Decodes the blocks of a file in order on background threads, keeping up to `window` blocks
+// ahead of the consumer. The memory use is thus bounded by `window` decompressed blocks.
+// With a memory budget, the buffer of each block is admitted along with its decode until the
+// block is released. Since the blocks are admitted in order, the block which is consumed next
+// never waits for memory held by later blocks, but blocks held by the caller count against it.
+struct BlockStream {
+  // A decoded block, whose buffer is recycled once this object is destroyed.
+  struct DecodedBlock {
+    DecodedBlock(BlockStream& stream, std::size_t slot) : stream_(&stream), slot_(slot) {}
+    DecodedBlock(const DecodedBlock&) = delete;
+    DecodedBlock(DecodedBlock&& other) noexcept
+        : stream_(std::exchange(other.stream_, nullptr)), slot_(other.slot_) {}
+    DecodedBlock& operator=(const DecodedBlock&) = delete;
+    DecodedBlock& operator=(DecodedBlock&&) = delete;
+    ~DecodedBlock() {
+      if (stream_ != nullptr) {
+        stream_->release(slot_);
+      }
+    }
+
+    [[nodiscard]] lzma_vli uoff() const {
+      return stream_->slots_[slot_].uoff;
+    }
+    [[nodiscard]] std::span<const std::byte> data() const {
+      const Slot& slot = stream_->slots_[slot_];
+      return {slot.buf.data(), slot.buf.size()};
+    }
+
+  private:
+    BlockStream* stream_;
+    std::size_t slot_;
+  };
+
+  explicit BlockStream(Reader& reader, BlockStreamParams params = {})
+      : reader_(reader), end_off_(range_end(reader, params)),
+        next_block_(end_off_ > 0 ? reader.iter_at(params.begin) : reader.begin()) {
+    const auto thread_num = std::max<std::size_t>(
+      params.thread_num.value_or(std::thread::hardware_concurrency()), 1);
+    slots_.resize(std::max<std::size_t>(params.window.value_or(2 * thread_num), 1));
+    threads_.reserve(thread_num);
+    for (std::size_t i = 0; i < thread_num; ++i) {
+      threads_.emplace_back([this] { work(); });
+    }
+  }
+  BlockStream(const BlockStream&) = delete;
+  BlockStream(BlockStream&&) = delete;
+  BlockStream& operator=(const BlockStream&) = delete;
+  BlockStream& operator=(BlockStream&&) = delete;
+  ~BlockStream() {
+    {
+      std::lock_guard lock{mutex_};
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // Returns the next block in order, waiting until it has been decoded,
+  // or std::nullopt once all blocks have been returned.
+  // Since blocks are decoded into a window of buffers, fewer than `window` blocks may be held
+  // by the caller when calling this function, which throws otherwise instead of waiting forever.
+  std::optional<DecodedBlock> next() {
+    std::unique_lock lock{mutex_};
+    const auto slot = consumed_ % slots_.size();
+    if (slots_[slot].state == SlotState::used && !(end_.has_value() && *end_ == consumed_)) {
+      throw Exception(fmt::format("All {} blocks of the window are held by the caller, so the "
+                                  "next block cannot be decoded!",
+                                  slots_.size()));
+    }
+    cv_.wait(lock, [&] {
+      return slots_[slot].state == SlotState::ready || (end_.has_value() && *end_ == consumed_);
+    });
+    if (slots_[slot].state != SlotState::ready) {
+      return std::nullopt;
+    }
+    if (slots_[slot].error != nullptr) {
+      std::rethrow_exception(slots_[slot].error);
+    }
+    slots_[slot].state = SlotState::used;
+    reader_.counters().deliver(slots_[slot].buf.size());
+    ++consumed_;
+    return DecodedBlock{*this, slot};
+  }
+
+private:
+  enum class SlotState { free, decoding, ready, used };
+  struct Slot {
+    SlotState state{SlotState::free};
+    lzma_vli uoff{};
+    thes::DynamicBuffer buf{};
+    std::exception_ptr error{};
+    std::optional<MemoryBudget::Reservation> reservation{};
+  };
+
+  void release(std::size_t slot) {
+    // With a budget, the memory of the buffer is returned to the budget along with its reservation.
+    if (slots_[slot].reservation.has_value()) {
+      slots_[slot].buf = thes::DynamicBuffer{};
+      slots_[slot].reservation.reset();
+    }
+    {
+      std::lock_guard lock{mutex_};
+      slots_[slot].state = SlotState::free;
+    }
+    cv_.notify_all();
+  }
+
+  // The end of the range, which is zero if the range is empty.
+  static std::size_t range_end(Reader& reader, const BlockStreamParams& params) {
+    const auto end = std::min<std::size_t>(params.end.value_or(reader.uncompressed_size()),
+                                           reader.uncompressed_size());
+    return params.begin < end ? end : 0;
+  }
+  // Whether all blocks overlapping the range have been dispatched.
+  bool is_done() {
+    return next_block_ == reader_.end() || next_block_->uoff() >= end_off_;
+  }
+
+  void work() {
+    Decoder decoder{reader_.budget().get()};
+    while (true) {
+      std::unique_lock lock{mutex_};
+      // The slot of the next block is free once the block `window` blocks earlier is released.
+      cv_.wait(lock, [&] {
+        return stop_ || end_.has_value() || is_done() ||
+               slots_[dispatched_ % slots_.size()].state == SlotState::free;
+      });
+      if (stop_ || end_.has_value()) {
+        return;
+      }
+      if (is_done()) {
+        end_ = dispatched_;
+        lock.unlock();
+        cv_.notify_all();
+        return;
+      }
+
+      const std::size_t index = dispatched_;
+      Slot& slot = slots_[index % slots_.size()];
+      slot.state = SlotState::decoding;
+      slot.error = nullptr;
+      Block block = *next_block_;
+      ++next_block_;
+      ++dispatched_;
+      lock.unlock();
+
+      slot.uoff = block.uoff();
+      // The locked decoder keeps the reservation for its state until the block has been decoded.
+      std::unique_lock<Decoder> pin{decoder, std::defer_lock};
+      try {
+        if (decoder.budget() != nullptr && !admit(index, block, slot, pin)) {
+          return;
+        }
+        slot.buf.resize(block.usize());
+        block.decompress(decoder, std::span{slot.buf.data(), slot.buf.size()});
+      } catch (...) {
+        slot.error = std::current_exception();
+      }
+      if (pin.owns_lock()) {
+        pin.unlock();
+      }
+
+      lock.lock();
+      slot.state = SlotState::ready;
+      lock.unlock();
+      cv_.notify_all();
+    }
+  }
+
+  // Admits the decode of the block with the given index and its buffer once all earlier blocks
+  // have been admitted, returning false if the stream is stopped in the meantime.
+  bool admit(std::size_t index, Block& block, Slot& slot, std::unique_lock<Decoder>& pin) {
+    Decoder& decoder = *pin.mutex();
+    std::exception_ptr error{};
+    std::size_t memusage = 0;
+    try {
+      memusage = block.memusage(decoder.scratch());
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    std::unique_lock lock{mutex_};
+    cv_.wait(lock, [&] { return stop_ || admitted_ == index; });
+    if (stop_) {
+      return false;
+    }
+    lock.unlock();
+    if (error == nullptr) {
+      try {
+        pin.lock();
+        slot.reservation = decoder.admit(memusage, block.usize());
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }
+    lock.lock();
+    ++admitted_;
+    lock.unlock();
+    cv_.notify_all();
+
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+    return true;
+  }
+
+  Reader& reader_;
+  std::size_t end_off_;
+  std::vector<Slot> slots_{};
+  std::vector<std::thread> threads_{};
+
+  std::mutex mutex_{};
+  std::condition_variable cv_{};
+  Reader::BlockIter next_block_;
+  // The number of blocks which have been handed to a thread and to the consumer, respectively.
+  std::size_t dispatched_{0};
+  std::size_t consumed_{0};
+  // The number of blocks whose decodes have been admitted by the budget, if there is one.
+  std::size_t admitted_{0};
+  // The number of blocks, which is known once all blocks have been dispatched.
+  std::optional<std::size_t> end_{};
+  bool stop_{false};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_DECODE_BLOCK_STREAM_HPP
@@ -1,43 +1,75 @@
 #ifndef INCLUDE_PLAZMA_DECODE_BLOCK_IPP
 #define INCLUDE_PLAZMA_DECODE_BLOCK_IPP
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
 #include <span>
 
 #include <lzma.h>
 
 #include "thesauros/containers.hpp"
 #include "thesauros/format.hpp"
+#include "thesauros/types.hpp"
 
 #include "plazma/base/block.hpp"
+#include "plazma/base/defs.hpp"
 #include "plazma/base/exception.hpp"
 #include "plazma/base/filters.hpp"
+#include "plazma/base/mapped-file.hpp"
+#include "plazma/base/sink.hpp"
+#include "plazma/base/source.hpp"
 #include "plazma/base/stream.hpp"
 #include "plazma/decode/decode.hpp"
+#include "plazma/decode/decoder.hpp"
+#include "plazma/decode/memory-budget.hpp"
 #include "plazma/decode/reader.hpp"
 
 namespace plazma {
-void Block::decompress(thes::DynamicBuffer& scratch, thes::DynamicBuffer& out) {
-  // read the header
-  lzma_block block{};
+inline std::optional<std::span<const std::byte>>
+Block::read_header(lzma_block& block, thes::DynamicBuffer& scratch) {
   block.version = 0;
   block.check = check();
 
-  Filters filters{};
-  block.filters = filters.data();
-
-  reader_.pread(scratch, 1, static_cast<long>(coff()));
-  block.header_size = lzma_block_header_size_decode(scratch[0]);
-  scratch.resize(block.header_size);
-  reader_.pread(std::span{scratch.data() + 1, block.header_size - 1},
-                static_cast<long>(coff()) + 1);
+  const ByteSource& source = reader_.source();
+  ReadCounters& counters = reader_.counters();
+  // The whole compressed block if it is available without reading.
+  std::optional<std::span<const std::byte>> data{};
+  if (!data_.empty()) {
+    assert(data_.size() == csize());
+    data = data_;
+  } else if (const auto memory = source.memory()) {
+    if (reader_.access() == Access::random) {
+      source.will_need(coff(), csize());
+    }
+    data = memory->subspan(coff(), csize());
+  }
+  const thes::u8* header = nullptr;
+  if (data.has_value()) {
+    header = reinterpret_cast<const thes::u8*>(data->data());
+    block.header_size = lzma_block_header_size_decode(*header);
+  } else {
+    scratch.resize(1);
+    source.pread(std::span{scratch.data(), 1}, coff());
+    block.header_size = lzma_block_header_size_decode(scratch[0]);
+    scratch.resize(block.header_size);
+    source.pread(std::span{scratch.data() + 1, block.header_size - 1}, coff() + 1);
+    header = scratch.data_u8();
+    counters.pread(1);
+    counters.pread(block.header_size - 1);
+  }
 
-  lzma_ret err = lzma_block_header_decode(&block, nullptr, scratch.data_u8());
+  lzma_ret err = lzma_block_header_decode(&block, nullptr, header);
   if (err == LZMA_OPTIONS_ERROR) {
-    throw Exception(
+    throw DataError(
       "The Block Header specifies some unsupported options such as unsupported filters.");
   }
   if (err == LZMA_DATA_ERROR) {
-    throw Exception("Block Header is corrupt, for example, the CRC32 doesn't match.");
+    throw DataError("Block Header is corrupt, for example, the CRC32 doesn't match.");
   }
   if (err == LZMA_PROG_ERROR) {
     throw Exception("Invalid arguments.");
@@ -45,17 +77,158 @@ void Block::decompress(thes::DynamicBuffer& scratch, thes::DynamicBuffer& out) {
   if (err != LZMA_OK) {
     throw Exception(fmt::format("Error in block header: {}", err));
   }
+  // let the decoder verify the sizes given by the index
+  if (lzma_block_compressed_size(&block, it_.block.unpadded_size) != LZMA_OK ||
+      (block.uncompressed_size != LZMA_VLI_UNKNOWN && block.uncompressed_size != usize())) {
+    throw DataError("The sizes in the Block Header do not match the index.");
+  }
+  block.uncompressed_size = usize();
+  return data;
+}
 
-  // decode the block
-  Stream s{};
-  if (lzma_block_decoder(&s, &block) != LZMA_OK) {
-    throw Exception("error initializing block decoder");
+inline std::size_t Block::filters_memusage(const lzma_block& block) {
+  const auto memusage = lzma_raw_decoder_memusage(block.filters);
+  if (memusage == UINT64_MAX) {
+    throw DataError("The filters of the block are invalid!");
+  }
+  return memusage;
+}
+inline std::size_t Block::memusage(thes::DynamicBuffer& scratch) {
+  lzma_block block{};
+  Filters filters{};
+  block.filters = filters.data();
+  read_header(block, scratch);
+  return filters_memusage(block);
+}
+
+template<typename TOnFull>
+inline void Block::decode(Stream& s, thes::DynamicBuffer& scratch, Decoder* decoder,
+                          thes::DynamicBuffer* buffer, std::span<std::byte> out,
+                          TOnFull&& on_full) {
+  lzma_block block{};
+  Filters filters{};
+  block.filters = filters.data();
+  const auto data = read_header(block, scratch);
+
+  // wait until the budget admits the memory required by the filters of this block and the
+  // buffer, while the locked decoder keeps its reservation until the block has been decoded
+  std::unique_lock<Decoder> lock{};
+  std::optional<MemoryBudget::Reservation> reservation{};
+  if (decoder != nullptr) {
+    lock = std::unique_lock{*decoder};
+    reservation = decoder->admit(filters_memusage(block), buffer != nullptr ? usize() : 0);
+  }
+  if (buffer != nullptr) {
+    buffer->resize(usize());
+    out = std::span{buffer->data(), buffer->size()};
   }
 
-  out.resize(usize());
-  s.next_out = out.data_u8();
+  // decode the block, which reuses the allocations of `s` if it has been used before
+  if (const lzma_ret err = lzma_block_decoder(&s, &block); err != LZMA_OK) {
+    throw_decode_error("Error initializing the block decoder", err);
+  }
+
+  ReadCounters& counters = reader_.counters();
+  s.next_out = reinterpret_cast<thes::u8*>(out.data());
   s.avail_out = out.size();
-  decode(s, reader_, scratch, coff() + block.header_size);
+  if (data.has_value()) {
+    plazma::decode(s, data->subspan(block.header_size), on_full, &counters);
+  } else {
+    plazma::decode(s, reader_.source(), scratch, coff() + block.header_size,
+                   csize() - block.header_size, on_full, &counters);
+  }
+  counters.block(s.total_out);
+}
+
+inline void Block::decode_range(Stream& s, thes::DynamicBuffer& scratch, Decoder* decoder,
+                                std::size_t begin, std::span<std::byte> out) {
+  assert(begin + out.size() <= usize());
+  if (begin == 0 && out.size() == usize()) {
+    decode(s, scratch, decoder, nullptr, out, DecodeToEnd{});
+    return;
+  }
+
+  std::array<std::byte, chunk_size> discard{};
+  // The number of bytes to discard which have not been assigned to an output buffer yet.
+  std::size_t skip = begin;
+  bool is_discarding = skip > 0;
+  const auto next_discard = [&] {
+    const auto num = std::min(skip, discard.size());
+    skip -= num;
+    return std::span{discard.data(), num};
+  };
+
+  const bool is_suffix = begin + out.size() == usize();
+  decode(s, scratch, decoder, nullptr, is_discarding ? next_discard() : out, [&](Stream& /*s*/) {
+    if (!is_discarding) {
+      // Decode until the end of the block to verify the check if the output extends to it.
+      return is_suffix;
+    }
+    std::span<std::byte> next = out;
+    if (skip > 0) {
+      next = next_discard();
+    } else {
+      is_discarding = false;
+      if (out.empty()) {
+        return is_suffix;
+      }
+    }
+    s.next_out = reinterpret_cast<thes::u8*>(next.data());
+    s.avail_out = next.size();
+    return true;
+  });
+}
+
+inline void Block::decompress(Decoder& decoder, std::span<std::byte> out) {
+  assert(out.size() == usize());
+  decode(decoder.stream(), decoder.scratch(), &decoder, nullptr, out, DecodeToEnd{});
+}
+inline void Block::decompress(Decoder& decoder, thes::DynamicBuffer& out) {
+  // The buffer is only allocated once it has been admitted by the budget.
+  decode(decoder.stream(), decoder.scratch(), &decoder, &out, {}, DecodeToEnd{});
+}
+inline void Block::decompress(Decoder& decoder, std::size_t begin, std::span<std::byte> out) {
+  decode_range(decoder.stream(), decoder.scratch(), &decoder, begin, out);
+}
+
+inline void Block::decompress(Decoder& decoder, SinkRef sink) {
+  if (usize() == 0) {
+    return;
+  }
+  thes::DynamicBuffer& buf = decoder.output();
+  buf.resize(std::min<std::size_t>(sink_chunk_size, usize()));
+  const auto chunk = std::span{buf.data(), buf.size()};
+  std::size_t written = 0;
+  decode(decoder.stream(), decoder.scratch(), &decoder, nullptr, chunk, [&](Stream& s) {
+    sink.write(chunk);
+    written += chunk.size();
+    s.next_out = buf.data_u8();
+    s.avail_out = chunk.size();
+    return true;
+  });
+  sink.write(chunk.first(usize() - written));
+}
+
+inline void Block::verify(Decoder& decoder) {
+  thes::DynamicBuffer& buf = decoder.output();
+  buf.resize(std::min<std::size_t>(sink_chunk_size, usize()));
+  decode(decoder.stream(), decoder.scratch(), &decoder, nullptr, std::span{buf.data(), buf.size()},
+         [&](Stream& s) {
+           s.next_out = buf.data_u8();
+           s.avail_out = buf.size();
+           return true;
+         });
+}
+
+inline void Block::decompress(thes::DynamicBuffer& scratch, std::span<std::byte> out) {
+  assert(out.size() == usize());
+  Stream s{};
+  decode(s, scratch, nullptr, nullptr, out, DecodeToEnd{});
+}
+inline void Block::decompress(thes::DynamicBuffer& scratch, std::size_t begin,
+                              std::span<std::byte> out) {
+  Stream s{};
+  decode_range(s, scratch, nullptr, begin, out);
 }
 } // namespace plazma
 
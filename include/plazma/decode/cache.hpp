@@ -0,0 +1,114 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_DECODE_CACHE_HPP
+#define INCLUDE_PLAZMA_DECODE_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include <lzma.h>
+
+#include "thesauros/containers.hpp"
+
+namespace plazma {
+struct BlockCacheStats {
+  std::size_t hits{};
+  std::size_t misses{};
+  std::size_t evictions{};
+  std::size_t entries{};
+  std::size_t bytes{};
+};
+
+// A size-bounded LRU cache of decompressed blocks, keyed by the compressed offset of the block.
+// Since the key is only unique within a file, a cache must only be shared among readers of the
+// same file. All member functions are thread-safe.
+struct BlockCache {
+  using Buffer = std::shared_ptr<const thes::DynamicBuffer>;
+
+  explicit BlockCache(std::size_t capacity) : capacity_(capacity) {}
+  BlockCache(const BlockCache&) = delete;
+  BlockCache(BlockCache&&) = delete;
+  BlockCache& operator=(const BlockCache&) = delete;
+  BlockCache& operator=(BlockCache&&) = delete;
+  ~BlockCache() = default;
+
+  // Returns the cached block at the given compressed offset or nullptr if it is not cached.
+  [[nodiscard]] Buffer find(lzma_vli coff) {
+    std::lock_guard lock{mutex_};
+    auto it = map_.find(coff);
+    if (it == map_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+    ++stats_.hits;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+  }
+
+  // Inserts a block, evicting the least recently used blocks as required, and returns the
+  // cached buffer, which is the existing one if another thread has inserted the block first.
+  // Blocks larger than the capacity are returned without being cached.
+  Buffer insert(lzma_vli coff, Buffer buf) {
+    std::lock_guard lock{mutex_};
+    if (auto it = map_.find(coff); it != map_.end()) {
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return it->second->second;
+    }
+    if (buf->size() > capacity_) {
+      return buf;
+    }
+    while (stats_.bytes + buf->size() > capacity_) {
+      evict();
+    }
+    stats_.bytes += buf->size();
+    ++stats_.entries;
+    entries_.emplace_front(coff, buf);
+    map_.emplace(coff, entries_.begin());
+    return buf;
+  }
+
+  void clear() {
+    std::lock_guard lock{mutex_};
+    map_.clear();
+    entries_.clear();
+    stats_.entries = 0;
+    stats_.bytes = 0;
+  }
+
+  [[nodiscard]] std::size_t capacity() const {
+    return capacity_;
+  }
+  [[nodiscard]] BlockCacheStats stats() const {
+    std::lock_guard lock{mutex_};
+    return stats_;
+  }
+
+private:
+  using Entry = std::pair<lzma_vli, Buffer>;
+
+  void evict() {
+    const Entry& entry = entries_.back();
+    stats_.bytes -= entry.second->size();
+    --stats_.entries;
+    ++stats_.evictions;
+    map_.erase(entry.first);
+    entries_.pop_back();
+  }
+
+  std::size_t capacity_;
+  mutable std::mutex mutex_{};
+  std::list<Entry> entries_{};
+  std::unordered_map<lzma_vli, std::list<Entry>::iterator> map_{};
+  BlockCacheStats stats_{};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_DECODE_CACHE_HPP
@@ -0,0 +1,268 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_DECODE_DATASET_HPP
+#define INCLUDE_PLAZMA_DECODE_DATASET_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <lzma.h>
+
+#include "thesauros/format.hpp"
+
+#include "plazma/base/exception.hpp"
+#include "plazma/base/parallel.hpp"
+#include "plazma/decode/decoder.hpp"
+#include "plazma/decode/index.hpp"
+#include "plazma/decode/reader.hpp"
+
+namespace plazma {
+struct DatasetParams {
+  // The maximum number of shards which are kept open when they are not in use.
+  std::size_t max_open{64};
+  // The parameters of the readers of the shards. A cache must not be given, since it is keyed by
+  // offsets within a single file, while a memory budget is shared among all shards.
+  ReaderParams reader{};
+};
+
+// A position in a dataset, given as the shard and the uncompressed offset within it.
+struct ShardOffset {
+  std::size_t shard;
+  std::size_t offset;
+};
+
+// The readers of the shards of a dataset which have been used most recently.
+// All member functions are thread-safe.
+struct ShardReaders {
+  using ReaderPtr = std::shared_ptr<Reader>;
+
+  explicit ShardReaders(std::size_t capacity) : capacity_(std::max<std::size_t>(capacity, 1)) {}
+
+  // Returns the open reader of the shard or opens it using `open`, closing the least recently
+  // used readers as required. Readers which are still in use are closed once they are released.
+  template<typename TOpen>
+  ReaderPtr acquire(std::size_t shard, TOpen&& open) {
+    {
+      std::lock_guard lock{mutex_};
+      if (auto it = map_.find(shard); it != map_.end()) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+      }
+    }
+
+    // Other shards can be acquired while the file is opened.
+    ReaderPtr reader = open();
+
+    std::lock_guard lock{mutex_};
+    if (auto it = map_.find(shard); it != map_.end()) {
+      // Another thread has opened the shard in the meantime.
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return it->second->second;
+    }
+    while (entries_.size() >= capacity_) {
+      map_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+    entries_.emplace_front(shard, reader);
+    map_.emplace(shard, entries_.begin());
+    return reader;
+  }
+
+  void clear() {
+    std::lock_guard lock{mutex_};
+    map_.clear();
+    entries_.clear();
+  }
+
+  [[nodiscard]] std::size_t capacity() const {
+    return capacity_;
+  }
+  [[nodiscard]] std::size_t size() const {
+    std::lock_guard lock{mutex_};
+    return entries_.size();
+  }
+
+private:
+  using Entry = std::pair<std::size_t, ReaderPtr>;
+
+  std::size_t capacity_;
+  mutable std::mutex mutex_{};
+  std::list<Entry> entries_{};
+  std::unordered_map<std::size_t, std::list<Entry>::iterator> map_{};
+};
+
+// A dataset which is split into XZ files, whose uncompressed data is addressed as the
+// concatenation of the shards in the given order.
+// The index of each shard is parsed once on construction and kept, while the files themselves
+// are only kept open for the most recently used shards.
+struct Dataset {
+  explicit Dataset(std::vector<std::filesystem::path> paths, DatasetParams params = {})
+      : paths_(std::move(paths)), params_(std::move(params)), readers_(params_.max_open),
+        decoders_(params_.reader.budget.get()) {
+    if (params_.reader.cache != nullptr) {
+      throw Exception("A block cache cannot be shared among the shards of a dataset!");
+    }
+    indices_.reserve(paths_.size());
+    offsets_.reserve(paths_.size() + 1);
+    offsets_.push_back(0);
+    for (std::size_t i = 0; i < paths_.size(); ++i) {
+      auto reader = open(i);
+      offsets_.push_back(offsets_.back() + reader->uncompressed_size());
+      indices_.push_back(reader->index());
+    }
+  }
+
+  [[nodiscard]] std::size_t shard_count() const {
+    return paths_.size();
+  }
+  [[nodiscard]] std::size_t uncompressed_size() const {
+    return offsets_.back();
+  }
+  [[nodiscard]] const std::filesystem::path& path(std::size_t shard) const {
+    return paths_[shard];
+  }
+  // The uncompressed offset at which the given shard starts.
+  [[nodiscard]] std::size_t shard_begin(std::size_t shard) const {
+    return offsets_[shard];
+  }
+  [[nodiscard]] std::size_t shard_end(std::size_t shard) const {
+    return offsets_[shard + 1];
+  }
+
+  // The shard which contains the given offset, which has to be less than `uncompressed_size()`.
+  [[nodiscard]] ShardOffset locate(std::size_t off) const {
+    if (off >= uncompressed_size()) {
+      throw Exception(fmt::format("The offset {} exceeds the uncompressed size {}!", off,
+                                  uncompressed_size()));
+    }
+    // Empty shards are skipped since their end equals the begin of the next shard.
+    const auto it = std::ranges::upper_bound(offsets_, off);
+    const auto shard = static_cast<std::size_t>(it - offsets_.begin()) - 1;
+    return {.shard = shard, .offset = off - offsets_[shard]};
+  }
+
+  // The reader of the given shard, which is opened if it is not open already.
+  [[nodiscard]] ShardReaders::ReaderPtr reader(std::size_t shard) {
+    return readers_.acquire(shard, [&] { return open(shard); });
+  }
+
+  template<typename T>
+  requires std::is_trivial_v<T>
+  void load_segment(std::size_t off, std::span<T> out) {
+    auto decoder = decoders_.acquire();
+    for_each_part(off * sizeof(T), out.size() * sizeof(T), [&](const Part& part) {
+      load_part(part, reinterpret_cast<std::byte*>(out.data()), *decoder);
+    });
+  }
+
+  // Loads a segment by decoding the blocks which overlap it on the threads of the given pool,
+  // which also decodes blocks of different shards in parallel.
+  template<typename T, typename TPool>
+  requires std::is_trivial_v<T>
+  void load_segment(std::size_t off, std::span<T> out, TPool& pool) {
+    // Each part is the intersection of the segment with one block.
+    std::vector<Part> parts{};
+    for_each_part(off * sizeof(T), out.size() * sizeof(T), [&](const Part& part) {
+      lzma_index_iter it{};
+      lzma_index_iter_init(&it, indices_[part.shard]->raw());
+      if (lzma_index_iter_locate(&it, part.offset) != 0) {
+        throw Exception("Locating block failed!");
+      }
+      for (std::size_t done = 0; done < part.size;) {
+        const auto local = part.offset + done;
+        const auto block_end = it.block.uncompressed_file_offset + it.block.uncompressed_size;
+        const auto num = std::min<std::size_t>(block_end - local, part.size - done);
+        parts.push_back(
+          {.shard = part.shard, .offset = local, .size = num, .out = part.out + done});
+        done += num;
+        if (done < part.size && lzma_index_iter_next(&it, LZMA_INDEX_ITER_NONEMPTY_BLOCK) != 0) {
+          throw Exception("Locating block failed!");
+        }
+      }
+    });
+
+    auto* data = reinterpret_cast<std::byte*>(out.data());
+    parallel_execute(pool, parts.size(), [&](std::size_t /*thread_idx*/, IndexQueue& queue) {
+      auto decoder = decoders_.acquire();
+      while (const std::optional<std::size_t> i = queue.claim()) {
+        load_part(parts[*i], data, *decoder);
+      }
+    });
+  }
+
+  [[nodiscard]] ShardReaders& readers() {
+    return readers_;
+  }
+  // The decoders used by `load_segment`, which are kept for subsequent calls.
+  [[nodiscard]] DecoderPool& decoders() {
+    return decoders_;
+  }
+
+private:
+  // A range within a shard and the offset of its data in the output.
+  struct Part {
+    std::size_t shard;
+    std::size_t offset;
+    std::size_t size;
+    std::size_t out;
+  };
+
+  ShardReaders::ReaderPtr open(std::size_t shard) {
+    return shard < indices_.size()
+             ? std::make_shared<Reader>(paths_[shard], indices_[shard], params_.reader)
+             : std::make_shared<Reader>(paths_[shard], params_.reader);
+  }
+
+  // Calls `fun` for the intersection of each shard with the given range of bytes.
+  template<typename TFun>
+  void for_each_part(std::size_t begin, std::size_t size, TFun&& fun) const {
+    if (begin + size > uncompressed_size()) {
+      throw Exception(fmt::format("The segment [{}, {}) exceeds the uncompressed size {}!", begin,
+                                  begin + size, uncompressed_size()));
+    }
+    if (size == 0) {
+      return;
+    }
+    const auto end = begin + size;
+    for (auto [shard, local] = locate(begin); shard < shard_count() && offsets_[shard] < end;
+         ++shard, local = 0) {
+      const auto num = std::min(shard_end(shard), end) - offsets_[shard] - local;
+      if (num > 0) {
+        const auto out = offsets_[shard] + local - begin;
+        fun(Part{.shard = shard, .offset = local, .size = num, .out = out});
+      }
+    }
+  }
+
+  void load_part(const Part& part, std::byte* data, Decoder& decoder) {
+    auto shard = reader(part.shard);
+    shard->load_segment(part.offset, std::span{data + part.out, part.size}, decoder);
+  }
+
+  std::vector<std::filesystem::path> paths_;
+  DatasetParams params_;
+  std::vector<std::shared_ptr<const Index>> indices_{};
+  // The prefix sums of the uncompressed sizes of the shards.
+  std::vector<std::size_t> offsets_{};
+  ShardReaders readers_;
+  // The decoders of `load_segment`, which are shared among the shards and kept for subsequent
+  // calls, i.e. their dictionaries are reused.
+  DecoderPool decoders_;
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_DECODE_DATASET_HPP
@@ -7,37 +7,137 @@
 #ifndef INCLUDE_PLAZMA_DECODE_DECODE_HPP
 #define INCLUDE_PLAZMA_DECODE_DECODE_HPP
 
+#include <algorithm>
+#include <cstddef>
 #include <optional>
+#include <span>
+#include <utility>
 
 #include <lzma.h>
 
 #include "thesauros/containers.hpp"
 #include "thesauros/format.hpp"
 #include "thesauros/io.hpp"
+#include "thesauros/types.hpp"
 
 #include "plazma/base/defs.hpp"
 #include "plazma/base/exception.hpp"
+#include "plazma/base/source.hpp"
+#include "plazma/base/stats.hpp"
 #include "plazma/base/stream.hpp"
 
 namespace plazma {
-inline void decode(Stream& s, thes::FileReader& fh, thes::DynamicBuffer& scratch,
-                   std::optional<long> opt_off = std::nullopt) {
-  long off = opt_off.value_or(fh.tell());
+// Throws `DataError` if liblzma has failed because of its input and `Exception` otherwise.
+[[noreturn]] inline void throw_decode_error(const char* what, lzma_ret err) {
+  auto msg = fmt::format("{}: {}", what, err);
+  switch (err) {
+  case LZMA_DATA_ERROR:
+  case LZMA_FORMAT_ERROR:
+  case LZMA_OPTIONS_ERROR:
+  case LZMA_BUF_ERROR: throw DataError(std::move(msg));
+  default: throw Exception(std::move(msg));
+  }
+}
+
+// The default handler for a full output buffer, which keeps decoding until the end of the stream.
+struct DecodeToEnd {
+  bool operator()(Stream& /*s*/) const {
+    return true;
+  }
+};
+
+// Decodes from memory, which avoids both the reads and the copies into a scratch buffer.
+template<typename TOnFull = DecodeToEnd>
+inline void decode(Stream& s, std::span<const std::byte> in, TOnFull&& on_full = {},
+                   ReadCounters* counters = nullptr) {
+  s.next_in = reinterpret_cast<const thes::u8*>(in.data());
+  s.avail_in = in.size();
 
+  lzma_ret err = LZMA_OK;
+  while (err != LZMA_STREAM_END) {
+    if (s.avail_out == 0 && !on_full(s)) {
+      return;
+    }
+    const Stopwatch watch{};
+    err = lzma_code(&s, LZMA_RUN);
+    if (counters != nullptr) {
+      counters->code(watch);
+    }
+    if (err != LZMA_OK and err != LZMA_STREAM_END) {
+      throw_decode_error("Error decoding", err);
+    }
+  }
+}
+
+// Decodes the `size` bytes at offset `off` of the given source. Sources in memory are decoded
+// directly, while all other sources are read in chunks into `scratch`.
+template<typename TOnFull = DecodeToEnd>
+inline void decode(Stream& s, const ByteSource& src, thes::DynamicBuffer& scratch, std::size_t off,
+                   std::size_t size, TOnFull&& on_full = {}, ReadCounters* counters = nullptr) {
+  if (const auto memory = src.memory()) {
+    decode(s, memory->subspan(off, size), std::forward<TOnFull>(on_full), counters);
+    return;
+  }
+
+  const std::size_t end = off + size;
   lzma_ret err = LZMA_OK;
   s.avail_in = 0;
   while (err != LZMA_STREAM_END) {
+    if (s.avail_out == 0 && !on_full(s)) {
+      return;
+    }
     if (s.avail_in == 0) {
-      s.avail_in = fh.try_pread(scratch, chunk_size, off);
-      off += static_cast<long>(scratch.size());
+      if (off == end) {
+        throw DataError("The input ended before the end of the stream!");
+      }
+      scratch.resize(std::min(chunk_size, end - off));
+      src.pread(std::span{scratch.data(), scratch.size()}, off);
+      off += scratch.size();
       s.next_in = scratch.data_u8();
+      s.avail_in = scratch.size();
+      if (counters != nullptr) {
+        counters->pread(scratch.size());
+      }
     }
+    const Stopwatch watch{};
     err = lzma_code(&s, LZMA_RUN);
+    if (counters != nullptr) {
+      counters->code(watch);
+    }
     if (err != LZMA_OK and err != LZMA_STREAM_END) {
-      throw Exception(fmt::format("Error decoding index: {}", err));
+      throw_decode_error("Error decoding", err);
     }
   }
 }
+
+// A source which reads from `fh` without owning it, i.e. which must not outlive it.
+inline ByteSource file_reader_source(thes::FileReader& fh) {
+  struct FileSource {
+    thes::FileReader* fh;
+    [[nodiscard]] std::size_t size() const {
+      return fh->size();
+    }
+    std::size_t try_pread(std::span<std::byte> out, std::size_t off) const {
+      return fh->try_pread(out, static_cast<long>(off));
+    }
+  };
+  return ByteSource::custom(FileSource{&fh});
+}
+
+// Decodes the input read from the given file, starting at `opt_off` or the current position of
+// the file, until the end of the stream.
+// Whenever the output buffer is full, `on_full` is called, which may provide a new output buffer
+// and returns whether to continue, i.e. decoding can be stopped before the end of the stream.
+// The reads and the time spent in liblzma are recorded in `counters` if given.
+template<typename TOnFull = DecodeToEnd>
+inline void decode(Stream& s, thes::FileReader& fh, thes::DynamicBuffer& scratch,
+                   std::optional<long> opt_off = std::nullopt, TOnFull&& on_full = {},
+                   ReadCounters* counters = nullptr) {
+  const auto off = static_cast<std::size_t>(opt_off.value_or(fh.tell()));
+  const ByteSource src = file_reader_source(fh);
+  decode(s, src, scratch, off, src.size() - std::min(off, src.size()),
+         std::forward<TOnFull>(on_full), counters);
+}
 } // namespace plazma
 
 #endif // INCLUDE_PLAZMA_DECODE_DECODE_HPP
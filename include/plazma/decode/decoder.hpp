@@ -0,0 +1,193 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_DECODE_DECODER_HPP
+#define INCLUDE_PLAZMA_DECODE_DECODER_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "thesauros/containers.hpp"
+
+#include "plazma/base/pool.hpp"
+#include "plazma/base/stream.hpp"
+#include "plazma/decode/memory-budget.hpp"
+
+namespace plazma {
+// A decoding context for one thread at a time. Since liblzma reinitializes a stream in place,
+// reusing it for consecutive blocks keeps the dictionary allocated as long as its size does not
+// change, and the scratch buffer is reused as well.
+// With a memory budget, the decoder reserves the memory for the state of liblzma and its output
+// buffer before each block, keeping the reservation until `clear()` or destruction. While the
+// decoder is idle, i.e. not locked, the budget may reclaim its state for other decodes.
+struct Decoder {
+  Decoder() = default;
+  explicit Decoder(MemoryBudget* budget) : budget_(budget) {
+    if (budget_ != nullptr) {
+      stream_.allocator = budget_->allocator();
+    }
+  }
+  Decoder(const Decoder&) = delete;
+  Decoder(Decoder&&) = delete;
+  Decoder& operator=(const Decoder&) = delete;
+  Decoder& operator=(Decoder&&) = delete;
+  ~Decoder() {
+    clear();
+  }
+
+  [[nodiscard]] Stream& stream() {
+    return stream_;
+  }
+  [[nodiscard]] thes::DynamicBuffer& scratch() {
+    return scratch_;
+  }
+  // The buffer for output which is passed on in chunks instead of being decoded in place.
+  [[nodiscard]] thes::DynamicBuffer& output() {
+    return output_;
+  }
+  [[nodiscard]] MemoryBudget* budget() const {
+    return budget_;
+  }
+  // The memory reserved for the state of this decoder, which is zero without a budget.
+  [[nodiscard]] std::size_t reserved() {
+    std::lock_guard lock{*this};
+    return reservation_.has_value() ? reservation_->size() : 0;
+  }
+
+  // A locked decoder keeps its reservation, which is done for the duration of each decode.
+  // Locking is recursive, e.g. to admit a decode before decoding.
+  void lock() {
+    mutex_.lock();
+    ++depth_;
+  }
+  void unlock() {
+    const bool idle = --depth_ == 0 && enrolled_;
+    mutex_.unlock();
+    if (idle) {
+      budget_->notify_idle();
+    }
+  }
+
+  // Calls `fun`, during which `admit` only waits for memory if `may_wait` is true, which must not
+  // be the case while the calling thread holds reservations that are not reclaimable.
+  // Otherwise, `admit` throws `AdmissionDeferred`, in which case false is returned.
+  template<typename TFun>
+  bool with_waiting(bool may_wait, TFun&& fun) {
+    const bool old = std::exchange(waiting_allowed_, may_wait);
+    try {
+      std::forward<TFun>(fun)();
+    } catch (const AdmissionDeferred& /*e*/) {
+      waiting_allowed_ = old;
+      return false;
+    } catch (...) {
+      waiting_allowed_ = old;
+      throw;
+    }
+    waiting_allowed_ = old;
+    return true;
+  }
+
+  // Ensures that the reservation of this decoder covers `state` bytes for liblzma as well as its
+  // output buffer, and reserves `buffer` bytes for a buffer, whose reservation is returned.
+  // If the current reservation does not suffice, the state of liblzma is freed before waiting.
+  // Requires the decoder to be locked. Does nothing without a budget.
+  std::optional<MemoryBudget::Reservation> admit(std::size_t state, std::size_t buffer = 0) {
+    if (budget_ == nullptr) {
+      return std::nullopt;
+    }
+    state += output_.size();
+    if (reservation_.has_value() && reservation_->size() >= state) {
+      if (buffer == 0) {
+        return std::nullopt;
+      }
+      if (auto reserved = budget_->try_reserve(buffer, MemoryUse::buffer)) {
+        return reserved;
+      }
+    }
+
+    std::optional<MemoryBudget::Reservation> total{};
+    if (waiting_allowed_) {
+      release();
+      total.emplace(budget_->reserve(state + buffer));
+    } else {
+      total = budget_->try_reserve(state + buffer, MemoryUse::decoder);
+      if (!total.has_value()) {
+        throw AdmissionDeferred{};
+      }
+      release();
+    }
+    std::optional<MemoryBudget::Reservation> reserved{};
+    if (buffer > 0) {
+      reserved.emplace(total->split(buffer, MemoryUse::buffer));
+    }
+    reservation_.emplace(std::move(*total));
+    budget_->enroll(this, &try_reclaim);
+    enrolled_ = true;
+    return reserved;
+  }
+
+  // Frees the state of liblzma and returns its memory to the budget.
+  void clear() {
+    std::lock_guard lock{mutex_};
+    release();
+  }
+
+private:
+  // Requires `mutex_` to be locked.
+  void release() {
+    if (enrolled_) {
+      budget_->withdraw(this);
+      enrolled_ = false;
+    }
+    stream_.reset();
+    reservation_.reset();
+  }
+
+  static bool try_reclaim(void* ptr) {
+    auto& self = *static_cast<Decoder*>(ptr);
+    std::unique_lock lock{self.mutex_, std::try_to_lock};
+    if (!lock.owns_lock()) {
+      return false;
+    }
+    // The budget unregisters the decoder itself.
+    self.enrolled_ = false;
+    self.stream_.reset();
+    self.reservation_.reset();
+    return true;
+  }
+
+  MemoryBudget* budget_{nullptr};
+  Stream stream_{};
+  thes::DynamicBuffer scratch_{};
+  thes::DynamicBuffer output_{};
+
+  std::recursive_mutex mutex_{};
+  std::size_t depth_{0};
+  bool enrolled_{false};
+  bool waiting_allowed_{true};
+  std::optional<MemoryBudget::Reservation> reservation_{};
+};
+
+// A thread-safe pool of decoders, which allows the threads of a thread pool to reuse decoders.
+struct DecoderPool : public ObjectPool<Decoder> {
+  DecoderPool() = default;
+  // Creates decoders which use the given memory budget, if any.
+  explicit DecoderPool(MemoryBudget* budget) : budget_(budget) {}
+
+  // Returns an unused decoder, creating one if there is none.
+  [[nodiscard]] Lease acquire() {
+    return ObjectPool::acquire([&] { return std::make_unique<Decoder>(budget_); });
+  }
+
+private:
+  MemoryBudget* budget_{nullptr};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_DECODE_DECODER_HPP
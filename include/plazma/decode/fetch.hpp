@@ -0,0 +1,326 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_DECODE_FETCH_HPP
+#define INCLUDE_PLAZMA_DECODE_FETCH_HPP
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "thesauros/containers.hpp"
+#include "thesauros/format.hpp"
+
+#include "plazma/base/exception.hpp"
+#include "plazma/base/source.hpp"
+#include "plazma/base/stats.hpp"
+#include "plazma/base/uring.hpp"
+#include "plazma/decode/memory-budget.hpp"
+
+namespace plazma {
+struct FetchParams {
+  // The maximum number of reads in flight per thread.
+  std::size_t depth{8};
+  // Whether to use io_uring if it is available. Otherwise, each read is a blocking pread.
+  bool io_uring{true};
+};
+
+// A range of the source to fetch, which is identified by `key` on completion.
+struct FetchRequest {
+  std::size_t key;
+  std::size_t off;
+  std::size_t size;
+};
+
+// Fetches whole ranges of a source, typically compressed blocks, with a single read each.
+// For file sources, up to `depth` reads are kept in flight using io_uring where it is available,
+// i.e. the data of later blocks is read while earlier ones are being decoded.
+// Sources in memory are passed on without reading, and other sources are read using pread.
+// With a memory budget, the buffers are admitted without waiting, since the consumer of the data
+// may have to wait for memory itself. A range whose buffer is not admitted is passed on without
+// data once no reads are in flight, i.e. the consumer has to read it from the source itself.
+struct BlockFetcher {
+  explicit BlockFetcher(const ByteSource& source, FetchParams params = {},
+                        ReadCounters* counters = nullptr, MemoryBudget* budget = nullptr)
+      : source_(source), depth_(std::max<std::size_t>(params.depth, 1)), counters_(counters),
+        budget_(budget) {
+    if (params.io_uring && source.fd() != -1 && !source.memory().has_value()) {
+      ring_ = Uring::create(static_cast<unsigned>(depth_));
+    }
+  }
+
+  // Whether the reads are submitted using io_uring.
+  [[nodiscard]] bool uses_io_uring() const {
+    return ring_ != nullptr;
+  }
+  // Whether buffers admitted by the budget are held.
+  [[nodiscard]] bool holds_memory() const {
+    return std::ranges::any_of(slots_,
+                               [](const Slot& slot) { return slot.reservation.has_value(); });
+  }
+
+  // Calls `next(held)`, which returns an optional `FetchRequest`, until it returns std::nullopt
+  // while no ranges are held, and `on_data(key, data)` for each range, whose data is only valid
+  // for the duration of the call. `held` is the number of ranges which have been requested but
+  // not passed on yet, and std::nullopt while ranges are held only stops fetching further ahead
+  // until one of them has been passed on.
+  // With io_uring, the ranges are passed on in the order in which their reads complete.
+  // `on_data` returns false if it cannot consume the data without waiting for memory, which is
+  // only allowed while `holds_memory()`. In this case, all buffers are freed and `on_data` is
+  // called with empty data for the range and all other ranges which have been requested.
+  // The fetcher can be reused for further runs, which keeps the ring and the buffers which have
+  // not been admitted by a budget, i.e. an idle fetcher does not hold any budgeted memory.
+  template<typename TNext, typename TOnData>
+  void run(TNext&& next, TOnData&& on_data) {
+    if (const auto memory = source_.memory()) {
+      while (const std::optional<FetchRequest> req = next(std::size_t{0})) {
+        [[maybe_unused]] const bool consumed =
+          on_data(req->key, memory->subspan(req->off, req->size));
+        assert(consumed);
+      }
+      return;
+    }
+    // The kernel writes into the buffers of all reads in flight, so they have to complete
+    // before the buffers are released, even if an exception is thrown.
+    try {
+      if (ring_ == nullptr) {
+        run_pread(next, on_data);
+      } else {
+        run_ring(next, on_data);
+      }
+    } catch (...) {
+      if (ring_ != nullptr) {
+        drain();
+      }
+      free_all();
+      throw;
+    }
+    free_all();
+  }
+
+private:
+  struct Slot {
+    thes::DynamicBuffer buf{};
+    FetchRequest req{};
+    std::size_t done{0};
+    // Whether the slot holds a range which has not been passed on yet.
+    bool busy{false};
+    std::optional<MemoryBudget::Reservation> reservation{};
+  };
+
+  // Reads are split into pieces which fit into the 32-bit length of a submission.
+  static constexpr std::size_t max_read = std::size_t{1} << 30;
+
+  template<typename TNext, typename TOnData>
+  void run_pread(TNext& next, TOnData& on_data) {
+    slots_.resize(1);
+    Slot& slot = slots_.front();
+    while (const std::optional<FetchRequest> req = next(std::size_t{0})) {
+      if (!admit(slot, req->size)) {
+        pass_on(req->key, on_data);
+        continue;
+      }
+      slot.buf.resize(req->size);
+      source_.pread(std::span{slot.buf.data(), req->size}, req->off);
+      record(req->size);
+      if (!on_data(req->key, std::span<const std::byte>{slot.buf.data(), req->size})) {
+        free(slot);
+        pass_on(req->key, on_data);
+      }
+    }
+  }
+
+  template<typename TNext, typename TOnData>
+  void run_ring(TNext& next, TOnData& on_data) {
+    slots_.resize(depth_);
+    std::vector<std::size_t> free_slots{};
+    const auto reset_free = [&] {
+      free_slots.resize(depth_);
+      for (std::size_t i = 0; i < depth_; ++i) {
+        free_slots[i] = depth_ - i - 1;
+      }
+    };
+    reset_free();
+    // A range which has been requested but whose buffer has not been admitted yet.
+    std::optional<FetchRequest> pending{};
+    std::array<UringCompletion, 32> completions{};
+
+    while (true) {
+      while (!free_slots.empty()) {
+        if (!pending.has_value()) {
+          pending = next(depth_ - free_slots.size());
+          if (!pending.has_value()) {
+            break;
+          }
+        }
+        const auto idx = free_slots.back();
+        if (!admit(slots_[idx], pending->size)) {
+          // The buffers of idle slots are only kept while they are not needed for other ranges.
+          for (const std::size_t i : free_slots) {
+            free(slots_[i]);
+          }
+          if (!admit(slots_[idx], pending->size)) {
+            if (ring_->in_flight() > 0) {
+              // The buffers of the reads in flight are freed once they have been consumed.
+              break;
+            }
+            pass_on(pending->key, on_data);
+            pending.reset();
+            continue;
+          }
+        }
+        free_slots.pop_back();
+        Slot& slot = slots_[idx];
+        slot.req = *pending;
+        slot.done = 0;
+        slot.busy = true;
+        slot.buf.resize(pending->size);
+        pending.reset();
+        queue(idx);
+      }
+      if (ring_->in_flight() == 0) {
+        return;
+      }
+
+      ring_->submit(1);
+      bool shed = false;
+      while (!shed) {
+        const auto num = ring_->reap(completions);
+        if (num == 0) {
+          break;
+        }
+        for (const UringCompletion& c : std::span{completions.data(), num}) {
+          const auto idx = static_cast<std::size_t>(c.user_data);
+          Slot& slot = slots_[idx];
+          if (c.res == -EINTR || c.res == -EAGAIN) {
+            queue(idx);
+            continue;
+          }
+          if (c.res < 0) {
+            throw Exception(fmt::format("Reading failed: {}", std::strerror(-c.res)));
+          }
+          if (c.res == 0) {
+            throw Exception(fmt::format("Reading {} bytes at offset {} failed, the size is {}!",
+                                        slot.req.size - slot.done, slot.req.off + slot.done,
+                                        source_.size()));
+          }
+          slot.done += static_cast<std::size_t>(c.res);
+          if (slot.done < slot.req.size) {
+            queue(idx);
+            continue;
+          }
+          record(slot.req.size);
+          if (!on_data(slot.req.key, std::span<const std::byte>{slot.buf.data(), slot.req.size})) {
+            // Free all buffers, including those of the remaining completions, and pass on the
+            // ranges without data, which their consumer can wait for memory for.
+            drain();
+            std::vector<std::size_t> keys{};
+            for (Slot& s : slots_) {
+              if (s.busy) {
+                keys.push_back(s.req.key);
+                s.busy = false;
+              }
+              free(s);
+            }
+            reset_free();
+            if (pending.has_value()) {
+              keys.push_back(pending->key);
+              pending.reset();
+            }
+            for (const std::size_t key : keys) {
+              pass_on(key, on_data);
+            }
+            shed = true;
+            break;
+          }
+          slot.busy = false;
+          free_slots.push_back(idx);
+        }
+      }
+    }
+  }
+
+  // Admits a buffer of the given size for the slot, whose buffer is kept for subsequent ranges.
+  bool admit(Slot& slot, std::size_t size) {
+    if (budget_ == nullptr || (slot.reservation.has_value() && slot.reservation->size() >= size)) {
+      return true;
+    }
+    free(slot);
+    slot.reservation = budget_->try_reserve(size, MemoryUse::buffer);
+    return slot.reservation.has_value();
+  }
+  // Frees the buffer of the slot if it has been admitted by the budget.
+  static void free(Slot& slot) {
+    if (slot.reservation.has_value()) {
+      slot.buf = thes::DynamicBuffer{};
+      slot.reservation.reset();
+    }
+  }
+
+  void free_all() {
+    for (Slot& slot : slots_) {
+      slot.busy = false;
+      free(slot);
+    }
+  }
+
+  // Passes on a range without data, which requires that no buffers are held.
+  template<typename TOnData>
+  void pass_on(std::size_t key, TOnData& on_data) {
+    assert(!holds_memory());
+    [[maybe_unused]] const bool consumed = on_data(key, std::span<const std::byte>{});
+    assert(consumed);
+  }
+
+  void queue(std::size_t idx) {
+    Slot& slot = slots_[idx];
+    const auto size = std::min(slot.req.size - slot.done, max_read);
+    // There are never more reads in flight than entries in the submission queue.
+    [[maybe_unused]] const bool queued =
+      ring_->queue_read(source_.fd(), std::span{slot.buf.data() + slot.done, size},
+                        slot.req.off + slot.done, idx);
+    assert(queued);
+  }
+
+  void drain() noexcept {
+    try {
+      std::array<UringCompletion, 32> completions{};
+      while (ring_->in_flight() > 0) {
+        ring_->submit(1);
+        while (ring_->reap(completions) > 0) {
+        }
+      }
+    } catch (...) {
+      // Without a working ring, the buffers cannot be released safely.
+      std::terminate();
+    }
+  }
+
+  void record(std::size_t size) {
+    if (counters_ != nullptr) {
+      counters_->pread(size);
+    }
+  }
+
+  const ByteSource& source_;
+  std::size_t depth_;
+  ReadCounters* counters_;
+  MemoryBudget* budget_;
+  std::unique_ptr<Uring> ring_{};
+  std::vector<Slot> slots_{};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_DECODE_FETCH_HPP
@@ -0,0 +1,226 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_DECODE_INDEX_FILE_HPP
+#define INCLUDE_PLAZMA_DECODE_INDEX_FILE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <lzma.h>
+
+#include "thesauros/containers.hpp"
+#include "thesauros/io.hpp"
+#include "thesauros/types.hpp"
+
+#include "plazma/base/exception.hpp"
+#include "plazma/base/source.hpp"
+#include "plazma/decode/index.hpp"
+
+// An index file (“sidecar”) stores the index of an XZ file in a flat binary format which can be
+// loaded using a single read, which avoids walking the XZ file stream by stream.
+// All values are stored in native byte order:
+// - An `IndexFileHeader`.
+// - `stream_count` `IndexFileStream`s.
+// - `block_count` `IndexFileBlock`s sorted by offset, i.e. the blocks of each stream in order.
+// - The CRC64 of everything before it as a `thes::u64`.
+namespace plazma {
+inline constexpr std::array<char, 8> index_file_magic{'P', 'L', 'A', 'Z', 'M', 'A', 'I', 'X'};
+inline constexpr thes::u32 index_file_version = 2;
+
+struct IndexFileHeader {
+  std::array<char, 8> magic;
+  thes::u32 version;
+  thes::u32 reserved;
+  // The size and modification time of the XZ file.
+  thes::u64 file_size;
+  thes::i64 file_mtime;
+  thes::u64 stream_count;
+  thes::u64 block_count;
+};
+struct IndexFileStream {
+  thes::u64 block_count;
+  thes::u64 padding;
+  thes::u64 backward_size;
+  thes::u32 check;
+  thes::u32 reserved;
+};
+struct IndexFileBlock {
+  thes::u64 compressed_offset;
+  thes::u64 uncompressed_offset;
+  thes::u64 unpadded_size;
+  thes::u64 uncompressed_size;
+};
+
+inline std::filesystem::path index_file_path(const std::filesystem::path& xz_path) {
+  auto path = xz_path;
+  path += ".pzi";
+  return path;
+}
+
+inline thes::i64 index_file_mtime(const std::filesystem::path& xz_path) {
+  return std::filesystem::last_write_time(xz_path).time_since_epoch().count();
+}
+
+// Writes the index file for the given XZ file and its index, which has to be complete.
+// The file is written to a temporary path first and then renamed, i.e. it is never partial.
+inline void write_index_file(const Index& index, const std::filesystem::path& xz_path) {
+  std::vector<IndexFileStream> streams{};
+  std::vector<IndexFileBlock> blocks{};
+
+  lzma_index_iter it;
+  lzma_index_iter_init(&it, index.raw());
+  while (lzma_index_iter_next(&it, LZMA_INDEX_ITER_STREAM) == 0) {
+    streams.push_back({
+      .block_count = it.stream.block_count,
+      .padding = it.stream.padding,
+      .backward_size = it.stream.flags->backward_size,
+      .check = static_cast<thes::u32>(it.stream.flags->check),
+      .reserved = 0,
+    });
+  }
+  lzma_index_iter_rewind(&it);
+  while (lzma_index_iter_next(&it, LZMA_INDEX_ITER_BLOCK) == 0) {
+    blocks.push_back({
+      .compressed_offset = it.block.compressed_file_offset,
+      .uncompressed_offset = it.block.uncompressed_file_offset,
+      .unpadded_size = it.block.unpadded_size,
+      .uncompressed_size = it.block.uncompressed_size,
+    });
+  }
+
+  const IndexFileHeader header{
+    .magic = index_file_magic,
+    .version = index_file_version,
+    .reserved = 0,
+    .file_size = index.file_size(),
+    .file_mtime = index_file_mtime(xz_path),
+    .stream_count = streams.size(),
+    .block_count = blocks.size(),
+  };
+
+  thes::u64 crc = lzma_crc64(reinterpret_cast<const thes::u8*>(&header), sizeof(header), 0);
+  crc = lzma_crc64(reinterpret_cast<const thes::u8*>(streams.data()),
+                   streams.size() * sizeof(IndexFileStream), crc);
+  crc = lzma_crc64(reinterpret_cast<const thes::u8*>(blocks.data()),
+                   blocks.size() * sizeof(IndexFileBlock), crc);
+
+  const auto path = index_file_path(xz_path);
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    thes::FileWriter writer{tmp_path};
+    writer.write(std::span{&header, 1});
+    writer.write(std::span{std::as_const(streams)});
+    writer.write(std::span{std::as_const(blocks)});
+    writer.write(std::span{&crc, 1});
+  }
+  std::filesystem::rename(tmp_path, path);
+}
+
+// Loads the index file of the given XZ file, whose data is provided by `xz`.
+// Returns nullptr if there is no index file, if it is corrupt, or if it does not match the XZ file.
+inline std::shared_ptr<const Index> load_index_file(const std::filesystem::path& xz_path,
+                                                    const ByteSource& xz) {
+  const auto path = index_file_path(xz_path);
+  std::error_code ec{};
+  const auto size = std::filesystem::file_size(path, ec);
+  if (ec || size < sizeof(IndexFileHeader)) {
+    return nullptr;
+  }
+
+  thes::DynamicBuffer buf{};
+  {
+    thes::FileReader reader{path};
+    reader.pread(buf, size, 0);
+  }
+
+  IndexFileHeader header;
+  std::memcpy(&header, buf.data(), sizeof(header));
+  if (header.magic != index_file_magic || header.version != index_file_version ||
+      header.file_size != xz.size() || header.file_mtime != index_file_mtime(xz_path) ||
+      size != sizeof(IndexFileHeader) + header.stream_count * sizeof(IndexFileStream) +
+                header.block_count * sizeof(IndexFileBlock) + sizeof(thes::u64)) {
+    return nullptr;
+  }
+  thes::u64 crc{};
+  std::memcpy(&crc, buf.data() + size - sizeof(crc), sizeof(crc));
+  if (lzma_crc64(buf.data_u8(), size - sizeof(crc), 0) != crc) {
+    return nullptr;
+  }
+
+  std::vector<IndexFileStream> streams(header.stream_count);
+  std::vector<IndexFileBlock> blocks(header.block_count);
+  const std::byte* ptr = buf.data() + sizeof(IndexFileHeader);
+  std::memcpy(streams.data(), ptr, streams.size() * sizeof(IndexFileStream));
+  ptr += streams.size() * sizeof(IndexFileStream);
+  std::memcpy(blocks.data(), ptr, blocks.size() * sizeof(IndexFileBlock));
+
+  // Rebuild the index stream by stream.
+  lzma_index* idx = nullptr;
+  const auto fail = [&] {
+    lzma_index_end(idx, nullptr);
+    return nullptr;
+  };
+  auto block_it = blocks.begin();
+  lzma_stream_flags flags{};
+  for (const IndexFileStream& stream : streams) {
+    lzma_index* sidx = lzma_index_init(nullptr);
+    if (sidx == nullptr) {
+      throw Exception("Allocating an index failed!");
+    }
+    if (static_cast<std::size_t>(blocks.end() - block_it) < stream.block_count) {
+      lzma_index_end(sidx, nullptr);
+      return fail();
+    }
+    for (thes::u64 i = 0; i < stream.block_count; ++i, ++block_it) {
+      if (lzma_index_append(sidx, nullptr, block_it->unpadded_size,
+                            block_it->uncompressed_size) != LZMA_OK) {
+        lzma_index_end(sidx, nullptr);
+        return fail();
+      }
+    }
+
+    flags = {};
+    flags.version = 0;
+    flags.backward_size = stream.backward_size;
+    flags.check = static_cast<lzma_check>(stream.check);
+    if (lzma_index_stream_flags(sidx, &flags) != LZMA_OK ||
+        lzma_index_stream_padding(sidx, stream.padding) != LZMA_OK ||
+        (idx != nullptr && lzma_index_cat(idx, sidx, nullptr) != LZMA_OK)) {
+      lzma_index_end(sidx, nullptr);
+      return fail();
+    }
+    if (idx == nullptr) {
+      idx = sidx;
+    }
+  }
+  if (idx == nullptr || block_it != blocks.end() || lzma_index_file_size(idx) != xz.size()) {
+    return fail();
+  }
+
+  // Compare the footer of the last stream with the file.
+  const auto padding = streams.back().padding;
+  const auto footer_off = lzma_index_file_size(idx) - padding - LZMA_STREAM_HEADER_SIZE;
+  std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> footer{};
+  std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> expected{};
+  xz.pread(std::as_writable_bytes(std::span{footer}), footer_off);
+  if (lzma_stream_footer_encode(&flags, expected.data()) != LZMA_OK || footer != expected) {
+    return fail();
+  }
+
+  return std::make_shared<const Index>(idx);
+}
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_DECODE_INDEX_FILE_HPP
@@ -0,0 +1,46 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_DECODE_INDEX_HPP
+#define INCLUDE_PLAZMA_DECODE_INDEX_HPP
+
+#include <cstddef>
+
+#include <lzma.h>
+
+namespace plazma {
+// A parsed index, which is immutable and can therefore be shared among any number of readers
+// of the same file, including readers on different threads.
+struct Index {
+  explicit Index(lzma_index* raw) : raw_(raw) {}
+  Index(const Index&) = delete;
+  Index(Index&&) = delete;
+  Index& operator=(const Index&) = delete;
+  Index& operator=(Index&&) = delete;
+  ~Index() {
+    lzma_index_end(raw_, nullptr);
+  }
+
+  [[nodiscard]] const lzma_index* raw() const {
+    return raw_;
+  }
+
+  [[nodiscard]] std::size_t uncompressed_size() const {
+    return lzma_index_uncompressed_size(raw_);
+  }
+  [[nodiscard]] std::size_t block_count() const {
+    return lzma_index_block_count(raw_);
+  }
+  [[nodiscard]] std::size_t file_size() const {
+    return lzma_index_file_size(raw_);
+  }
+
+private:
+  lzma_index* raw_;
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_DECODE_INDEX_HPP
@@ -0,0 +1,314 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_DECODE_MEMORY_BUDGET_HPP
+#define INCLUDE_PLAZMA_DECODE_MEMORY_BUDGET_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <lzma.h>
+
+#include "thesauros/format.hpp"
+
+#include "plazma/base/exception.hpp"
+
+namespace plazma {
+// The kind of memory which is admitted by a reservation.
+enum class MemoryUse {
+  // The state of a decoder, i.e. the memory allocated by liblzma and its output buffer.
+  decoder,
+  // A buffer of compressed or decompressed data, e.g. a fetched or a cached block.
+  buffer,
+};
+
+struct MemoryBudgetStats {
+  std::size_t limit{};
+  // The memory admitted for decoders and buffers, both currently and at most.
+  std::size_t reserved{};
+  std::size_t peak_reserved{};
+  // The part of the reserved memory which is admitted for buffers, both currently and at most.
+  std::size_t buffers{};
+  std::size_t peak_buffers{};
+  // The memory allocated by liblzma, both currently and at most, and the number of allocations.
+  std::size_t allocated{};
+  std::size_t peak_allocated{};
+  std::size_t allocations{};
+  // The number of reservations which had to wait for memory to become available.
+  std::size_t waits{};
+  // The number of idle decoders whose memory has been reclaimed for other reservations.
+  std::size_t reclaims{};
+};
+
+// Thrown by a decoder which must not wait for memory if its decode cannot be admitted at once,
+// e.g. because its thread holds fetched blocks which other decodes may be waiting for.
+struct AdmissionDeferred {};
+
+// Bounds the memory used by concurrent block decodes. Before decoding a block, a decoder reserves
+// the memory which liblzma reports for its filters, waiting until the reservations of the other
+// decodes leave enough room. Buffers which hold whole blocks are reserved as well.
+// A decoder keeps its reservation between blocks to reuse its state, but the reservations of idle
+// decoders are reclaimed while a reservation waits, i.e. idle decoders never block other decodes.
+// The allocations by liblzma are counted by a custom allocator.
+// All member functions are thread-safe.
+struct MemoryBudget {
+  // Reserved memory which is returned to the budget on destruction.
+  struct Reservation {
+    Reservation(MemoryBudget& budget, std::size_t size, MemoryUse use)
+        : budget_(&budget), size_(size), use_(use) {}
+    Reservation(const Reservation&) = delete;
+    Reservation(Reservation&& other) noexcept
+        : budget_(std::exchange(other.budget_, nullptr)), size_(other.size_), use_(other.use_) {}
+    Reservation& operator=(const Reservation&) = delete;
+    Reservation& operator=(Reservation&& other) noexcept {
+      if (this != &other) {
+        if (budget_ != nullptr) {
+          budget_->release(size_, use_);
+        }
+        budget_ = std::exchange(other.budget_, nullptr);
+        size_ = other.size_;
+        use_ = other.use_;
+      }
+      return *this;
+    }
+    ~Reservation() {
+      if (budget_ != nullptr) {
+        budget_->release(size_, use_);
+      }
+    }
+
+    [[nodiscard]] std::size_t size() const {
+      return size_;
+    }
+    [[nodiscard]] MemoryUse use() const {
+      return use_;
+    }
+
+    // Moves `size` bytes of this reservation into a new reservation for the given use.
+    [[nodiscard]] Reservation split(std::size_t size, MemoryUse use) {
+      assert(budget_ != nullptr && size <= size_);
+      budget_->transfer(size, use_, use);
+      size_ -= size;
+      return {*budget_, size, use};
+    }
+
+  private:
+    MemoryBudget* budget_;
+    std::size_t size_;
+    MemoryUse use_;
+  };
+
+  explicit MemoryBudget(std::size_t limit)
+      : limit_(limit), allocator_{.alloc = &allocate, .free = &deallocate, .opaque = this} {}
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget(MemoryBudget&&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(MemoryBudget&&) = delete;
+  ~MemoryBudget() = default;
+
+  // Waits until `size` bytes are available and reserves them, reclaiming the memory of idle
+  // decoders as required. The caller must not hold any reservations which are not reclaimable,
+  // since these could prevent the reservations it waits for from being released.
+  // Throws if `size` exceeds the limit, since such a reservation could never be admitted.
+  [[nodiscard]] Reservation reserve(std::size_t size, MemoryUse use = MemoryUse::decoder) {
+    if (size > limit_) {
+      throw Exception(fmt::format("Decoding requires {} bytes, which exceeds the memory budget "
+                                  "of {} bytes!",
+                                  size, limit_));
+    }
+    std::unique_lock lock{mutex_};
+    bool waited = false;
+    while (reserved_ + size > limit_) {
+      // Decoders which become idle after the attempt to reclaim memory increment `idle_`.
+      const auto idle = idle_;
+      lock.unlock();
+      const bool reclaimed = reclaim();
+      lock.lock();
+      if (reclaimed || idle != idle_ || reserved_ + size <= limit_) {
+        continue;
+      }
+      if (!waited) {
+        ++waits_;
+        waited = true;
+      }
+      cv_.wait(lock, [&] { return reserved_ + size <= limit_ || idle != idle_; });
+    }
+    admit(size, use);
+    return {*this, size, use};
+  }
+
+  // Reserves `size` bytes if they are available without waiting.
+  [[nodiscard]] std::optional<Reservation> try_reserve(std::size_t size, MemoryUse use) {
+    std::lock_guard lock{mutex_};
+    if (reserved_ + size > limit_) {
+      return std::nullopt;
+    }
+    admit(size, use);
+    return Reservation{*this, size, use};
+  }
+
+  // Registers the owner of a reservation which can be reclaimed while the owner is idle.
+  // `try_reclaim(owner)` releases the reservation of the owner and returns true if it is idle,
+  // and returns false otherwise. It must not call `enroll` or `withdraw`.
+  void enroll(void* owner, bool (*try_reclaim)(void*)) {
+    std::lock_guard lock{reclaim_mutex_};
+    owners_.push_back({.ptr = owner, .try_reclaim = try_reclaim});
+  }
+  // Unregisters an owner, which has to be done before it is destroyed.
+  void withdraw(void* owner) {
+    std::lock_guard lock{reclaim_mutex_};
+    std::erase_if(owners_, [&](const Owner& o) { return o.ptr == owner; });
+  }
+  // Notifies waiting reservations that a registered owner has become idle.
+  void notify_idle() {
+    {
+      std::lock_guard lock{mutex_};
+      ++idle_;
+    }
+    cv_.notify_all();
+  }
+
+  // An allocator which counts the memory allocated by liblzma.
+  [[nodiscard]] const lzma_allocator* allocator() const {
+    return &allocator_;
+  }
+
+  [[nodiscard]] std::size_t limit() const {
+    return limit_;
+  }
+  [[nodiscard]] MemoryBudgetStats stats() const {
+    std::lock_guard lock{mutex_};
+    return {
+      .limit = limit_,
+      .reserved = reserved_,
+      .peak_reserved = peak_reserved_,
+      .buffers = buffers_,
+      .peak_buffers = peak_buffers_,
+      .allocated = allocated_,
+      .peak_allocated = peak_allocated_,
+      .allocations = allocations_,
+      .waits = waits_,
+      .reclaims = reclaims_,
+    };
+  }
+
+private:
+  struct Owner {
+    void* ptr;
+    bool (*try_reclaim)(void*);
+  };
+
+  // The size of each allocation is stored in front of it, since `deallocate` does not receive it.
+  static constexpr std::size_t header_size = alignof(std::max_align_t);
+
+  static void* allocate(void* opaque, std::size_t nmemb, std::size_t size) {
+    auto& self = *static_cast<MemoryBudget*>(opaque);
+    if (size != 0 && nmemb > (SIZE_MAX - header_size) / size) {
+      return nullptr;
+    }
+    const std::size_t bytes = nmemb * size;
+    auto* ptr = static_cast<std::byte*>(std::malloc(header_size + bytes));
+    if (ptr == nullptr) {
+      return nullptr;
+    }
+    *reinterpret_cast<std::size_t*>(ptr) = bytes;
+    {
+      std::lock_guard lock{self.mutex_};
+      self.allocated_ += bytes;
+      self.peak_allocated_ = std::max(self.peak_allocated_, self.allocated_);
+      ++self.allocations_;
+    }
+    return ptr + header_size;
+  }
+  static void deallocate(void* opaque, void* ptr) {
+    if (ptr == nullptr) {
+      return;
+    }
+    auto& self = *static_cast<MemoryBudget*>(opaque);
+    auto* base = static_cast<std::byte*>(ptr) - header_size;
+    {
+      std::lock_guard lock{self.mutex_};
+      self.allocated_ -= *reinterpret_cast<std::size_t*>(base);
+    }
+    std::free(base);
+  }
+
+  // Reclaims the reservations of all idle owners, returning whether there have been any.
+  bool reclaim() {
+    std::lock_guard lock{reclaim_mutex_};
+    const auto num = std::erase_if(owners_, [](const Owner& o) { return o.try_reclaim(o.ptr); });
+    if (num > 0) {
+      std::lock_guard stats_lock{mutex_};
+      reclaims_ += num;
+    }
+    return num > 0;
+  }
+
+  // The following functions require `mutex_` to be locked.
+  void admit(std::size_t size, MemoryUse use) {
+    reserved_ += size;
+    peak_reserved_ = std::max(peak_reserved_, reserved_);
+    if (use == MemoryUse::buffer) {
+      buffers_ += size;
+      peak_buffers_ = std::max(peak_buffers_, buffers_);
+    }
+  }
+
+  void release(std::size_t size, MemoryUse use) {
+    {
+      std::lock_guard lock{mutex_};
+      reserved_ -= size;
+      if (use == MemoryUse::buffer) {
+        buffers_ -= size;
+      }
+    }
+    cv_.notify_all();
+  }
+  void transfer(std::size_t size, MemoryUse from, MemoryUse to) {
+    if (from == to) {
+      return;
+    }
+    std::lock_guard lock{mutex_};
+    if (to == MemoryUse::buffer) {
+      buffers_ += size;
+      peak_buffers_ = std::max(peak_buffers_, buffers_);
+    } else {
+      buffers_ -= size;
+    }
+  }
+
+  std::size_t limit_;
+  lzma_allocator allocator_;
+
+  mutable std::mutex mutex_{};
+  std::condition_variable cv_{};
+  std::size_t reserved_{0};
+  std::size_t peak_reserved_{0};
+  std::size_t buffers_{0};
+  std::size_t peak_buffers_{0};
+  std::size_t allocated_{0};
+  std::size_t peak_allocated_{0};
+  std::size_t allocations_{0};
+  std::size_t waits_{0};
+  std::size_t reclaims_{0};
+  // Incremented whenever a registered owner becomes idle.
+  std::size_t idle_{0};
+
+  // Locked before `mutex_` if both are locked.
+  std::mutex reclaim_mutex_{};
+  std::vector<Owner> owners_{};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_DECODE_MEMORY_BUDGET_HPP
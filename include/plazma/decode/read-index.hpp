@@ -8,99 +8,138 @@
 #define INCLUDE_PLAZMA_DECODE_READ_INDEX_HPP
 
 #include <algorithm>
-#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <span>
 
 #include <lzma.h>
 
 #include "thesauros/containers.hpp"
+#include "thesauros/format.hpp"
 #include "thesauros/io.hpp"
 #include "thesauros/memory.hpp"
 #include "thesauros/types.hpp"
 
 #include "plazma/base/defs.hpp"
 #include "plazma/base/exception.hpp"
+#include "plazma/base/source.hpp"
 #include "plazma/base/stream.hpp"
 #include "plazma/decode/decode.hpp"
 
 namespace plazma {
-inline lzma_index* read_index(thes::FileReader& fh) {
+inline void check_stream_header(const thes::u8* header) {
+  lzma_stream_flags flags;
+  lzma_ret ret = lzma_stream_header_decode(&flags, header);
+  if (ret == LZMA_FORMAT_ERROR) {
+    throw Exception("Magic bytes don't match, thus the given buffer cannot be Stream Header.");
+  }
+  if (ret == LZMA_DATA_ERROR) {
+    throw Exception("CRC32 doesn't match, thus the header is corrupt.");
+  }
+  if (ret == LZMA_OPTIONS_ERROR) {
+    throw Exception("Unsupported options are present in the header.");
+  }
+  if (ret != LZMA_OK) {
+    throw Exception(fmt::format("Invalid header: {}", ret));
+  }
+}
+
+// Sets the parameters of the index of a stream and prepends it to the indices of any later streams.
+inline lzma_index* merge_stream_index(lzma_index* nidx, lzma_index* idx,
+                                      const lzma_stream_flags& flags, lzma_vli pad) {
+  if (lzma_index_stream_flags(nidx, &flags) != LZMA_OK) {
+    throw Exception("Error setting stream flags");
+  }
+  if (lzma_index_stream_padding(nidx, pad) != LZMA_OK) {
+    throw Exception("Error setting stream padding");
+  }
+  if (idx != nullptr && lzma_index_cat(nidx, idx, nullptr) != LZMA_OK) {
+    throw Exception("Error combining indices");
+  }
+  return nidx;
+}
+
+// Reads the index of all streams in the given source, starting from the last one.
+inline lzma_index* read_index(const ByteSource& src) {
   static_assert(chunk_size % 4 == 0);
 
   lzma_index* idx = nullptr;
   thes::DynamicBuffer buf{};
+  // The given range of the source, which is only copied if the source is not in memory.
+  const auto view = [&](std::size_t off, std::size_t size) -> std::span<const std::byte> {
+    if (const auto memory = src.memory()) {
+      return memory->subspan(off, size);
+    }
+    buf.resize(size);
+    src.pread(std::span{buf.data(), size}, off);
+    return std::span{buf.data(), size};
+  };
 
-  fh.seek(0, thes::Seek::end);
+  std::size_t pos = src.size();
   while (true) {
     // Skip any padding.
     lzma_vli pad = 0;
-
     [&] {
       while (true) {
-        const auto p = fh.tell();
-        if (p < LZMA_STREAM_HEADER_SIZE) {
+        if (pos < LZMA_STREAM_HEADER_SIZE) {
           throw Exception("Padding is not allowed at the start!");
         }
-        const auto s = std::min(p, static_cast<long>(chunk_size));
-        fh.seek(p - s, thes::Seek::set);
-        fh.read(buf, static_cast<std::size_t>(s));
-
-        for (std::byte* it = buf.data() + buf.size(); it != buf.data(); it -= 4) {
-          auto* f = it - 4;
-          if (thes::byte_read<std::uint32_t>(f) != 0) {
-            fh.seek(f - buf.data() - static_cast<long>(buf.size()) + 4, thes::Seek::cur);
+        const auto size = std::min(pos, chunk_size) / 4 * 4;
+        const auto chunk = view(pos - size, size);
+        for (auto i = size; i != 0; i -= 4) {
+          if (thes::byte_read<std::uint32_t>(chunk.data() + i - 4) != 0) {
             return;
           }
+          pos -= 4;
           pad += 4;
         }
-        fh.seek(p - s, thes::Seek::set);
       }
     }();
 
     // Read the footer
     lzma_stream_flags flags;
-    fh.seek(-LZMA_STREAM_HEADER_SIZE, thes::Seek::cur);
-
-    std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> footer{};
-    fh.read(footer);
-    lzma_ret err = lzma_stream_footer_decode(&flags, footer.data());
-    if (err != LZMA_OK) {
+    pos -= LZMA_STREAM_HEADER_SIZE;
+    const auto footer = view(pos, LZMA_STREAM_HEADER_SIZE);
+    lzma_ret err =
+      lzma_stream_footer_decode(&flags, reinterpret_cast<const thes::u8*>(footer.data()));
+    if (err != LZMA_OK || flags.backward_size > pos) {
       throw Exception("Bad Footer");
     }
-    long npos = fh.tell();
+    std::size_t npos = pos + LZMA_STREAM_HEADER_SIZE;
 
     // Read the index
-    fh.seek(-LZMA_STREAM_HEADER_SIZE - static_cast<long>(flags.backward_size), thes::Seek::cur);
+    pos -= flags.backward_size;
     lzma_index* nidx{};
     {
       Stream s{};
       if (lzma_index_decoder(&s, &nidx, UINT64_MAX) != LZMA_OK) {
         throw Exception("Error initializing index decoder");
       }
-      decode(s, fh, buf);
-    }
-    npos -= static_cast<long>(lzma_index_file_size(nidx));
-
-    // Set index params, combine with any later indices
-    if (lzma_index_stream_flags(nidx, &flags) != LZMA_OK) {
-      throw Exception("Error setting stream flags");
-    }
-    if (lzma_index_stream_padding(nidx, pad) != LZMA_OK) {
-      throw Exception("Error setting stream padding");
+      decode(s, src, buf, pos, flags.backward_size);
     }
-    if (idx != nullptr && lzma_index_cat(nidx, idx, nullptr) != LZMA_OK) {
-      throw Exception("Error combining indices");
+    if (lzma_index_file_size(nidx) > npos) {
+      throw Exception("The index is larger than the file!");
     }
-    idx = nidx;
+    npos -= lzma_index_file_size(nidx);
+
+    idx = merge_stream_index(nidx, idx, flags, pad);
 
     if (npos == 0) {
       return idx;
     }
-    fh.seek(npos, thes::Seek::set);
+    pos = npos;
   }
 }
+
+// Reads the index of a file which is available in memory, e.g. using a mapping.
+inline lzma_index* read_index(std::span<const std::byte> data) {
+  return read_index(ByteSource::memory(data));
+}
+
+inline lzma_index* read_index(thes::FileReader& fh) {
+  return read_index(file_reader_source(fh));
+}
 } // namespace plazma
 
 #endif // INCLUDE_PLAZMA_DECODE_READ_INDEX_HPP
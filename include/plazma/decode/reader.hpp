@@ -9,11 +9,19 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstring>
+#include <exception>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <span>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <lzma.h>
 
@@ -24,10 +32,87 @@
 #include "thesauros/utility.hpp"
 
 #include "plazma/base.hpp"
+#include "plazma/decode/cache.hpp"
+#include "plazma/decode/decoder.hpp"
+#include "plazma/decode/fetch.hpp"
+#include "plazma/decode/index-file.hpp"
+#include "plazma/decode/index.hpp"
+#include "plazma/decode/memory-budget.hpp"
 #include "plazma/decode/read-index.hpp"
 
 namespace plazma {
-struct Reader : public thes::FileReader {
+enum class InputMode {
+  // Read the compressed data in chunks using positional reads.
+  pread,
+  // Map the file into memory and let liblzma read from the mapping directly.
+  mmap,
+};
+
+enum class IndexFileMode {
+  // Always parse the index from the XZ file.
+  ignore,
+  // Load the index file if it exists and matches the XZ file.
+  load,
+  // Like `load`, but write the index file if it does not exist or is outdated.
+  load_or_create,
+};
+
+// The weight of a block when partitioning a file.
+enum class PartitionWeight {
+  // The compressed size, i.e. the amount of data to read.
+  compressed,
+  // The sum of the compressed and the uncompressed size as an estimate of the decoding time,
+  // which is dominated by the output for compressible and by the input for incompressible data.
+  decode_cost,
+};
+
+// A range of uncompressed offsets.
+struct UncompressedRange {
+  std::size_t begin;
+  std::size_t end;
+
+  [[nodiscard]] std::size_t size() const {
+    return end - begin;
+  }
+};
+
+// A block whose data does not match its header, its integrity check, or the index.
+struct CorruptBlock {
+  // The position of the block in the file, counting from zero.
+  std::size_t index;
+  std::size_t coff;
+  std::size_t uoff;
+  std::string error;
+};
+
+struct VerifyReport {
+  std::size_t block_count{0};
+  // The number of uncompressed bytes in blocks which are intact.
+  std::size_t verified_size{0};
+  // The corrupt blocks sorted by their position.
+  std::vector<CorruptBlock> corrupt_blocks{};
+  // Inconsistencies between the index and the rest of the file, e.g. the stream headers.
+  std::vector<std::string> index_errors{};
+
+  [[nodiscard]] bool ok() const {
+    return corrupt_blocks.empty() && index_errors.empty();
+  }
+};
+
+struct ReaderParams {
+  InputMode input{InputMode::pread};
+  IndexFileMode index_file{IndexFileMode::ignore};
+  // The expected access pattern, which is only relevant for mapped input.
+  Access access{Access::normal};
+  // A cache of decompressed blocks, which may be shared among readers of the same file.
+  std::shared_ptr<BlockCache> cache{};
+  // A memory budget which admits block decodes, which may be shared among readers.
+  std::shared_ptr<MemoryBudget> budget{};
+  // How the compressed blocks are read when decoding blocks on a thread pool.
+  FetchParams fetch{};
+};
+
+struct Reader {
   struct BlockSentinel {};
 
   struct BlockIter {
@@ -81,40 +166,37 @@ struct Reader : public thes::FileReader {
     bool is_end_{false};
   };
 
-  explicit Reader(const std::filesystem::path& path)
-      : thes::FileReader(path), index_([this] {
-          std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> header{};
-          read(header);
-
-          lzma_stream_flags flags;
-          lzma_ret ret = lzma_stream_header_decode(&flags, header.data());
-          if (ret == LZMA_FORMAT_ERROR) {
-            throw Exception(
-              "Magic bytes don't match, thus the given buffer cannot be Stream Header.");
-          }
-          if (ret == LZMA_DATA_ERROR) {
-            throw Exception("CRC32 doesn't match, thus the header is corrupt.");
-          }
-          if (ret == LZMA_OPTIONS_ERROR) {
-            throw Exception("Unsupported options are present in the header.");
-          }
-          if (ret != LZMA_OK) {
-            throw Exception(fmt::format("Invalid header: {}", ret));
-          }
-
-          return read_index(*this);
-        }()) {}
+  explicit Reader(const std::filesystem::path& path, ReaderParams params = {})
+      : Reader(path, nullptr, std::move(params)) {}
+  // Opens a reader which uses an index that has already been parsed, e.g. by another reader
+  // of the same file, instead of parsing it again.
+  Reader(const std::filesystem::path& path, std::shared_ptr<const Index> index,
+         ReaderParams params = {})
+      : source_(params.input == InputMode::mmap
+                  ? ByteSource::mapped(MappedFile{path, params.access})
+                  : ByteSource::file(path)),
+        index_(index == nullptr ? load_index(path, params.index_file)
+                                : check_index(std::move(index))),
+        access_(params.access), fetch_(params.fetch), cache_(std::move(params.cache)),
+        budget_(std::move(params.budget)), decoders_(budget_.get()) {}
+  // Opens a reader of data from an arbitrary source, e.g. memory or an object store.
+  // `params.input` and `params.index_file` are ignored, since the source determines the former
+  // and there is no path to place an index file next to.
+  explicit Reader(ByteSource source, ReaderParams params = {})
+      : Reader(std::move(source), nullptr, std::move(params)) {}
+  Reader(ByteSource source, std::shared_ptr<const Index> index, ReaderParams params = {})
+      : source_(std::move(source)),
+        index_(index == nullptr ? parse_index() : check_index(std::move(index))),
+        access_(params.access), fetch_(params.fetch), cache_(std::move(params.cache)),
+        budget_(std::move(params.budget)), decoders_(budget_.get()) {}
   Reader(const Reader&) = delete;
   Reader(Reader&&) = delete;
   Reader& operator=(const Reader&) = delete;
   Reader& operator=(Reader&&) = delete;
-
-  ~Reader() {
-    lzma_index_end(index_, nullptr);
-  }
+  ~Reader() = default;
 
   [[nodiscard]] BlockIter iter_at(lzma_vli off) {
-    BlockIter iter(*this, index_);
+    BlockIter iter(*this, index_->raw());
     const auto ret = lzma_index_iter_locate(&iter.raw(), off);
     if (ret == 1) {
       throw Exception("Locating block failed!");
@@ -125,42 +207,344 @@ struct Reader : public thes::FileReader {
   template<typename T>
   requires std::is_trivial_v<T>
   void load_segment(std::size_t off, std::span<T> out) {
+    auto decoder = decoders_.acquire();
+    load_segment(off, out, *decoder);
+  }
+  template<typename T>
+  requires std::is_trivial_v<T>
+  void load_segment(std::size_t off, std::span<T> out, Decoder& decoder) {
     const auto offset = off * sizeof(T);
     const auto size = out.size() * sizeof(T);
     auto* data = reinterpret_cast<std::byte*>(out.data());
 
     auto it_end = end();
     const auto out_end = offset + size;
-    thes::DynamicBuffer scratch{};
-    thes::DynamicBuffer buf{};
     for (auto it = iter_at(static_cast<lzma_vli>(offset)); it != it_end and it->uoff() < out_end;
          ++it) {
-      it->decompress(scratch, buf);
-      const auto common_begin = std::max<std::size_t>(offset, it->uoff());
-      const auto buf_begin = common_begin - it->uoff();
-      const auto out_begin = common_begin - offset;
-      const auto num = std::min<std::size_t>(it->uend(), out_end) - common_begin;
-      std::memcpy(data + out_begin, buf.data() + buf_begin, num);
+      load_block(*it, offset, out_end, data, decoder);
+    }
+    counters_.deliver(size);
+  }
+
+  // Loads a segment by decoding the blocks which overlap it on the threads of the given pool.
+  // Each block is decoded by exactly one thread, which writes directly into the output.
+  template<typename T, typename TPool>
+  requires std::is_trivial_v<T>
+  void load_segment(std::size_t off, std::span<T> out, TPool& pool) {
+    const auto offset = off * sizeof(T);
+    const auto size = out.size() * sizeof(T);
+    auto* data = reinterpret_cast<std::byte*>(out.data());
+
+    auto it_end = end();
+    const auto out_end = offset + size;
+    std::vector<lzma_index_iter> blocks{};
+    for (auto it = iter_at(static_cast<lzma_vli>(offset)); it != it_end and it->uoff() < out_end;
+         ++it) {
+      blocks.push_back(it.raw());
+    }
+
+    decode_blocks(pool, blocks, [&](Block block, Decoder& decoder) {
+      load_block(block, offset, out_end, data, decoder);
+    });
+    counters_.deliver(size);
+  }
+
+  // Calls `fun(block, decoder)` for each of the given blocks on the threads of the given pool,
+  // with the compressed data of the blocks fetched ahead as configured by `ReaderParams::fetch`.
+  // Each thread claims blocks in order, but completes them in the order in which they arrive.
+  // A thread only claims more than one block ahead while enough unclaimed blocks remain for the
+  // other threads of the pool, so that all threads decode blocks.
+  // With a budget, `fun` may be called again for a block if its decode could not be admitted
+  // while the fetched data was held, i.e. it has to be repeatable up to the decode.
+  template<typename TPool, typename TFun>
+  void decode_blocks(TPool& pool, std::span<const lzma_index_iter> blocks, TFun&& fun) {
+    const std::size_t thread_num = pool.thread_num();
+    parallel_execute(pool, blocks.size(), [&](std::size_t /*thread_idx*/, IndexQueue& queue) {
+      auto decoder = decoders_.acquire();
+      auto fetcher = fetchers_.acquire([&] {
+        return std::make_unique<BlockFetcher>(source_, fetch_, &counters_, budget_.get());
+      });
+      fetcher->run(
+        [&](std::size_t held) -> std::optional<FetchRequest> {
+          // Blocks are only claimed ahead while enough remain for the other threads.
+          if (held > 0 && held * thread_num >= queue.remaining()) {
+            return std::nullopt;
+          }
+          const std::optional<std::size_t> i = queue.claim();
+          if (!i.has_value()) {
+            return std::nullopt;
+          }
+          const Block block(*this, blocks[*i]);
+          return FetchRequest{.key = *i, .off = block.coff(), .size = block.csize()};
+        },
+        [&](std::size_t i, std::span<const std::byte> compressed) {
+          // While fetched blocks are held, waiting for memory could block the other threads.
+          return decoder->with_waiting(!fetcher->holds_memory(), [&] {
+            fun(Block(*this, blocks[i], compressed), *decoder);
+          });
+        });
+    });
+  }
+
+  // Decodes all blocks on the threads of the given pool without keeping their output, which
+  // verifies their integrity checks and their sizes, as well as the stream headers against the
+  // index. The memory use does not depend on the size of the file.
+  // Corrupt blocks, i.e. those which throw `DataError`, are reported instead of stopping the
+  // verification, while all other errors throw, e.g. failed reads or an exceeded memory budget.
+  template<typename TPool>
+  VerifyReport verify(TPool& pool) {
+    VerifyReport report{.block_count = block_count()};
+    check_streams(report.index_errors);
+
+    std::vector<lzma_index_iter> blocks{};
+    blocks.reserve(block_count());
+    for (auto it = begin(); it != end(); ++it) {
+      blocks.push_back(it.raw());
+    }
+
+    std::atomic<std::size_t> verified_size{0};
+    std::mutex corrupt_mutex{};
+    decode_blocks(pool, blocks, [&](Block block, Decoder& decoder) {
+      try {
+        block.verify(decoder);
+        verified_size += block.usize();
+      } catch (const DataError& e) {
+        std::lock_guard lock{corrupt_mutex};
+        report.corrupt_blocks.push_back({
+          .index = block.raw().block.number_in_file - 1,
+          .coff = block.coff(),
+          .uoff = block.uoff(),
+          .error = e.what(),
+        });
+      }
+    });
+    report.verified_size = verified_size;
+    std::ranges::sort(report.corrupt_blocks, {}, &CorruptBlock::index);
+    return report;
+  }
+
+  // Splits the file into at most `n` consecutive ranges whose boundaries are block boundaries and
+  // whose weights are as close to equal as block boundaries allow. Loading the ranges separately
+  // thus decodes each block exactly once.
+  [[nodiscard]] std::vector<UncompressedRange>
+  partition(std::size_t n, PartitionWeight weight = PartitionWeight::decode_cost) {
+    if (n == 0) {
+      throw Exception("A file can only be split into a positive number of ranges!");
+    }
+    const auto weight_of = [&](const Block& block) -> thes::u64 {
+      return weight == PartitionWeight::compressed ? block.csize() : block.csize() + block.usize();
+    };
+    thes::u64 total = 0;
+    for (Block block : *this) {
+      total += weight_of(block);
+    }
+
+    std::vector<UncompressedRange> ranges{};
+    // The weight of the blocks preceding the current one.
+    thes::u64 acc = 0;
+    std::size_t begin = 0;
+    for (Block block : *this) {
+      const auto w = weight_of(block);
+      if (ranges.size() + 1 < n) {
+        const auto target = total * (ranges.size() + 1) / n;
+        if (acc + w >= target) {
+          // End the range before or after this block, whichever is closer to the target.
+          const bool before = block.uoff() > begin && target - acc < acc + w - target;
+          const std::size_t cut = before ? block.uoff() : block.uend();
+          ranges.push_back({begin, cut});
+          begin = cut;
+        }
+      }
+      acc += w;
+    }
+    if (begin < uncompressed_size()) {
+      ranges.push_back({begin, uncompressed_size()});
+    }
+    return ranges;
+  }
+
+  // Partitions the file into one range per thread of the pool and calls `fun` with each range
+  // on its own thread, e.g. to load it using `load_segment`.
+  template<typename TPool, typename TFun>
+  void execute_partitioned(TPool& pool, TFun&& fun,
+                           PartitionWeight weight = PartitionWeight::decode_cost) {
+    const auto ranges = partition(pool.thread_num(), weight);
+    parallel_execute(pool, ranges.size(), [&](std::size_t thread_idx, IndexQueue& /*queue*/) {
+      if (thread_idx < ranges.size()) {
+        fun(ranges[thread_idx]);
+      }
+    });
+  }
+
+  // Decompresses the whole file in order and writes it to `sink` in chunks without finishing it,
+  // i.e. the memory use does not depend on the size of the file or its blocks.
+  void decompress(SinkRef sink) {
+    auto decoder = decoders_.acquire();
+    for (Block block : *this) {
+      block.decompress(*decoder, sink);
+      counters_.deliver(block.usize());
     }
   }
 
   [[nodiscard]] BlockIter begin() {
-    return BlockIter(*this, index_);
+    // A freshly initialized iterator is positioned before the first block.
+    BlockIter iter(*this, index_->raw());
+    ++iter;
+    return iter;
   }
   [[nodiscard]] BlockSentinel end() {
     return BlockSentinel{};
   }
 
   [[nodiscard]] std::size_t uncompressed_size() {
-    return lzma_index_uncompressed_size(index_);
+    return index_->uncompressed_size();
   }
   [[nodiscard]] std::size_t block_count() {
-    return lzma_index_block_count(index_);
+    return index_->block_count();
+  }
+  [[nodiscard]] const std::shared_ptr<const Index>& index() const {
+    return index_;
+  }
+
+  // The decoders used by `load_segment` if none is given, which are kept for subsequent calls.
+  [[nodiscard]] DecoderPool& decoders() {
+    return decoders_;
+  }
+  [[nodiscard]] const std::shared_ptr<BlockCache>& cache() const {
+    return cache_;
+  }
+  // The statistics of this reader, which are only recorded if `PLAZMA_STATS` is enabled.
+  [[nodiscard]] ReadStats stats() const {
+    return counters_.snapshot();
+  }
+  [[nodiscard]] ReadCounters& counters() {
+    return counters_;
+  }
+  // The memory budget used by the decoders of this reader, if any.
+  [[nodiscard]] const std::shared_ptr<MemoryBudget>& budget() const {
+    return budget_;
+  }
+  // The compressed data, i.e. the file or the source given on construction.
+  [[nodiscard]] const ByteSource& source() const {
+    return source_;
+  }
+  // The compressed size.
+  [[nodiscard]] std::size_t size() const {
+    return source_.size();
+  }
+  // The mapping of the file if the reader uses mapped input, nullptr otherwise.
+  [[nodiscard]] const MappedFile* mapping() const {
+    return source_.mapping();
+  }
+  [[nodiscard]] Access access() const {
+    return access_;
+  }
+  [[nodiscard]] const FetchParams& fetch() const {
+    return fetch_;
   }
 
 private:
-  lzma_index* index_;
+  std::shared_ptr<const Index> parse_index() {
+    std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> header{};
+    if (source_.size() < header.size()) {
+      throw Exception("The file is too small to contain a Stream Header.");
+    }
+    source_.pread(std::as_writable_bytes(std::span{header}), 0);
+    check_stream_header(header.data());
+
+    return std::make_shared<const Index>(read_index(source_));
+  }
+  std::shared_ptr<const Index> load_index(const std::filesystem::path& path,
+                                          IndexFileMode mode) {
+    if (mode == IndexFileMode::ignore) {
+      return parse_index();
+    }
+    if (auto index = load_index_file(path, source_)) {
+      return index;
+    }
+    auto index = parse_index();
+    if (mode == IndexFileMode::load_or_create) {
+      try {
+        write_index_file(*index, path);
+      } catch (const std::exception& /*e*/) {
+        // The index file is only a cache, so e.g. a read-only directory is not an error.
+      }
+    }
+    return index;
+  }
+  std::shared_ptr<const Index> check_index(std::shared_ptr<const Index> index) {
+    const auto file_size = source_.size();
+    if (index->file_size() != file_size) {
+      throw Exception(
+        fmt::format("The index describes a file of size {}, but the file has size {}!",
+                    index->file_size(), file_size));
+    }
+    return index;
+  }
+
+  // Compares the size of the file and the header of each stream with the index.
+  void check_streams(std::vector<std::string>& errors) {
+    // The size of the file matches the index, which is checked when the index is loaded.
+    lzma_index_iter it{};
+    lzma_index_iter_init(&it, index_->raw());
+    while (lzma_index_iter_next(&it, LZMA_INDEX_ITER_STREAM) == 0) {
+      std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> header{};
+      source_.pread(std::as_writable_bytes(std::span{header}), it.stream.compressed_offset);
+      lzma_stream_flags flags{};
+      if (lzma_stream_header_decode(&flags, header.data()) != LZMA_OK ||
+          lzma_stream_flags_compare(&flags, it.stream.flags) != LZMA_OK) {
+        errors.push_back(fmt::format("The header of stream {} at offset {} is corrupt!",
+                                     it.stream.number, it.stream.compressed_offset));
+      }
+    }
+  }
+
+  // Loads the intersection of the block with [offset, out_end) into the output.
+  void load_block(Block block, std::size_t offset, std::size_t out_end, std::byte* data,
+                  Decoder& decoder) {
+    const auto common_begin = std::max<std::size_t>(offset, block.uoff());
+    const auto buf_begin = common_begin - block.uoff();
+    const auto out_begin = common_begin - offset;
+    const auto num = std::min<std::size_t>(block.uend(), out_end) - common_begin;
+
+    if (cache_ != nullptr) {
+      // The whole block is decompressed so that it can be cached.
+      const auto cached = load_cached(block, decoder);
+      std::memcpy(data + out_begin, cached->data() + buf_begin, num);
+    } else {
+      // Only the required part of the block is decompressed, directly into the output.
+      block.decompress(decoder, buf_begin, std::span{data + out_begin, num});
+    }
+  }
+
+  BlockCache::Buffer load_cached(Block block, Decoder& decoder) {
+    if (auto cached = cache_->find(block.coff())) {
+      return cached;
+    }
+    // With a budget, the buffer is admitted while it is filled and bounded by the cache afterwards.
+    auto buf = std::make_shared<thes::DynamicBuffer>();
+    block.decompress(decoder, *buf);
+    return cache_->insert(block.coff(), std::move(buf));
+  }
+
+  ByteSource source_;
+  std::shared_ptr<const Index> index_;
+  Access access_;
+  FetchParams fetch_;
+  std::shared_ptr<BlockCache> cache_;
+  std::shared_ptr<MemoryBudget> budget_;
+  DecoderPool decoders_;
+  // The fetchers used by `decode_blocks`, which keep their rings for subsequent calls.
+  ObjectPool<BlockFetcher> fetchers_{};
+  ReadCounters counters_{};
 };
+
+// Parses the index of an XZ file which has been written completely and writes its index file.
+inline std::shared_ptr<const Index> create_index_file(const std::filesystem::path& path) {
+  Reader reader{path};
+  write_index_file(*reader.index(), path);
+  return reader.index();
+}
 } // namespace plazma
 
 #endif // INCLUDE_PLAZMA_DECODE_READER_HPP
@@ -2,6 +2,10 @@
 #define INCLUDE_PLAZMA_ENCODE_HPP
 
 // IWYU pragma: begin_exports
+#include "encode/append.hpp"
+#include "encode/block-writer.hpp"
+#include "encode/filter-chain.hpp"
+#include "encode/split.hpp"
 #include "encode/writer.hpp"
 // IWYU pragma: end_exports
 
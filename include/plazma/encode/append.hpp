@@ -0,0 +1,308 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_ENCODE_APPEND_HPP
+#define INCLUDE_PLAZMA_ENCODE_APPEND_HPP
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <lzma.h>
+
+#include "thesauros/containers.hpp"
+#include "thesauros/format.hpp"
+#include "thesauros/types.hpp"
+
+#include "plazma/base/exception.hpp"
+#include "plazma/base/file.hpp"
+#include "plazma/base/source.hpp"
+#include "plazma/decode/read-index.hpp"
+
+// Appending to an XZ file overwrites the index and the footer of its last stream with new blocks,
+// followed by an index of the old and the new blocks and a new footer. Before the file is
+// modified, its original tail, i.e. everything starting at that index, is stored in a journal
+// (“.pzj”) next to it, which is removed once the new index has been written durably.
+// If an append is interrupted, the journal is used to restore the original file by
+// `recover_append`, which is also called before each append. Since the file may have been
+// replaced in the meantime, the journal also identifies the file it belongs to.
+// The journal consists of an `AppendJournalHeader` followed by the original tail.
+namespace plazma {
+inline constexpr std::array<char, 8> append_journal_magic{'P', 'L', 'A', 'Z', 'M', 'A', 'J', 'L'};
+inline constexpr thes::u32 append_journal_version = 2;
+// The number of bytes preceding the tail whose CRC64 identifies the file, which is bounded so
+// that the cost of an append does not depend on the size of the file.
+inline constexpr std::size_t append_journal_check_size = std::size_t{1} << 20;
+
+struct AppendJournalHeader {
+  std::array<char, 8> magic;
+  thes::u32 version;
+  thes::u32 reserved;
+  // The size of the XZ file before the append and the offset of the tail stored in the journal.
+  thes::u64 file_size;
+  thes::u64 tail_offset;
+  // The device and inode of the XZ file and the CRC64 of the (at most
+  // `append_journal_check_size`) bytes preceding the tail, which an append does not modify.
+  thes::u64 device;
+  thes::u64 inode;
+  thes::u64 prefix_crc;
+};
+
+inline std::filesystem::path append_journal_path(const std::filesystem::path& xz_path) {
+  auto path = xz_path;
+  path += ".pzj";
+  return path;
+}
+
+// Removes the journal of the given XZ file if there is one, e.g. since the file is overwritten.
+inline void discard_append_journal(const std::filesystem::path& xz_path) {
+  std::error_code ec{};
+  std::filesystem::remove(append_journal_path(xz_path), ec);
+}
+
+// The device and inode of the given file.
+inline std::pair<thes::u64, thes::u64> append_file_identity(const std::filesystem::path& path) {
+  struct stat st{};
+  if (::stat(path.c_str(), &st) == -1) {
+    throw Exception(fmt::format("Reading the status of {} failed: {}", path.string(),
+                                std::strerror(errno)));
+  }
+  return {static_cast<thes::u64>(st.st_dev), static_cast<thes::u64>(st.st_ino)};
+}
+// The CRC64 of the bytes preceding `tail_offset` which are stored in an `AppendJournalHeader`.
+inline thes::u64 append_prefix_crc(const ByteSource& source, std::size_t tail_offset) {
+  const auto size = std::min(tail_offset, append_journal_check_size);
+  thes::DynamicBuffer buf{};
+  buf.resize(size);
+  source.pread(std::span{buf.data(), size}, tail_offset - size);
+  return lzma_crc64(buf.data_u8(), size, 0);
+}
+
+// Restores the XZ file if an append to it has been interrupted, returning whether this was the
+// case. Nothing happens if there is no journal.
+// Throws if the journal belongs to another file, e.g. if the file has been replaced after the
+// interrupted append, in which case the journal has to be removed to append to the file.
+inline bool recover_append(const std::filesystem::path& xz_path) {
+  const auto path = append_journal_path(xz_path);
+  std::error_code ec{};
+  const auto size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return false;
+  }
+
+  // The journal is renamed into place once complete, i.e. it is never partial.
+  AppendJournalHeader header{};
+  thes::DynamicBuffer tail{};
+  {
+    if (size < sizeof(header)) {
+      throw Exception(fmt::format("The append journal {} is corrupt!", path.string()));
+    }
+    const ByteSource journal = ByteSource::file(path);
+    journal.pread(std::as_writable_bytes(std::span{&header, 1}), 0);
+    if (header.magic != append_journal_magic || header.version != append_journal_version ||
+        header.tail_offset > header.file_size ||
+        size != sizeof(header) + header.file_size - header.tail_offset) {
+      throw Exception(fmt::format("The append journal {} is corrupt!", path.string()));
+    }
+    tail.resize(size - sizeof(header));
+    journal.pread(std::span{tail.data(), tail.size()}, sizeof(header));
+  }
+  {
+    std::error_code ec{};
+    const bool matches = [&] {
+      if (!std::filesystem::exists(xz_path, ec) ||
+          append_file_identity(xz_path) != std::pair{header.device, header.inode}) {
+        return false;
+      }
+      const ByteSource source = ByteSource::file(xz_path);
+      return source.size() >= header.tail_offset &&
+             append_prefix_crc(source, header.tail_offset) == header.prefix_crc;
+    }();
+    if (!matches) {
+      throw Exception(fmt::format("The append journal {} does not belong to {}, which has been "
+                                  "replaced since the append was interrupted!",
+                                  path.string(), xz_path.string()));
+    }
+  }
+
+  {
+    OutputFile file{xz_path, OutputFile::Mode::update};
+    file.pwrite(std::span{tail.data(), tail.size()}, header.tail_offset);
+    file.truncate(header.file_size);
+    file.sync();
+  }
+  std::filesystem::remove(path);
+  sync_directory(std::filesystem::absolute(xz_path).parent_path());
+  return true;
+}
+
+// The last stream of an existing XZ file to which blocks are appended.
+struct AppendTarget {
+  // Prepares appending to the given file, whose journal is written durably before returning.
+  // Returns std::nullopt if the file does not exist or is empty, i.e. there is nothing to keep.
+  static std::optional<AppendTarget> prepare(const std::filesystem::path& xz_path) {
+    recover_append(xz_path);
+    std::error_code ec{};
+    if (std::filesystem::file_size(xz_path, ec) == 0 || ec) {
+      return std::nullopt;
+    }
+
+    const ByteSource source = ByteSource::file(xz_path);
+    std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> header{};
+    if (source.size() < header.size()) {
+      throw Exception("The file is too small to contain a Stream Header.");
+    }
+    source.pread(std::as_writable_bytes(std::span{header}), 0);
+    check_stream_header(header.data());
+    const IndexPtr index{read_index(source)};
+
+    AppendTarget target{xz_path};
+    lzma_index_iter it{};
+    lzma_index_iter_init(&it, index.get());
+    while (lzma_index_iter_next(&it, LZMA_INDEX_ITER_STREAM) == 0) {
+      target.flags_ = *it.stream.flags;
+      target.offset_ = it.stream.compressed_offset + it.stream.compressed_size -
+                       LZMA_STREAM_HEADER_SIZE - it.stream.flags->backward_size;
+      target.stream_ = it.stream.number;
+    }
+    lzma_index_iter_rewind(&it);
+    while (lzma_index_iter_next(&it, LZMA_INDEX_ITER_BLOCK) == 0) {
+      if (it.stream.number == target.stream_) {
+        target.records_.push_back({it.block.unpadded_size, it.block.uncompressed_size});
+      }
+    }
+
+    // Store the original tail, which is written to a temporary path first and then renamed.
+    thes::DynamicBuffer tail{};
+    tail.resize(source.size() - target.offset_);
+    source.pread(std::span{tail.data(), tail.size()}, target.offset_);
+    const auto [device, inode] = append_file_identity(xz_path);
+    const AppendJournalHeader journal_header{
+      .magic = append_journal_magic,
+      .version = append_journal_version,
+      .reserved = 0,
+      .file_size = source.size(),
+      .tail_offset = target.offset_,
+      .device = device,
+      .inode = inode,
+      .prefix_crc = append_prefix_crc(source, target.offset_),
+    };
+    const auto path = append_journal_path(xz_path);
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+    {
+      OutputFile journal{tmp_path};
+      journal.pwrite(std::as_bytes(std::span{&journal_header, 1}), 0);
+      journal.pwrite(std::span{tail.data(), tail.size()}, sizeof(journal_header));
+      journal.sync();
+    }
+    std::filesystem::rename(tmp_path, path);
+    sync_directory(std::filesystem::absolute(xz_path).parent_path());
+    return target;
+  }
+
+  // The offset of the index of the last stream, at which the new blocks are written.
+  [[nodiscard]] std::size_t offset() const {
+    return offset_;
+  }
+  // The integrity check of the last stream, which the new blocks have to use as well.
+  [[nodiscard]] lzma_check check() const {
+    return flags_.check;
+  }
+
+  // Completes the append once a complete stream without its header has been written to `file`
+  // in [offset(), end), whose blocks are kept while its index and footer are replaced.
+  void complete(const OutputFile& file, std::size_t end) {
+    // Read the index of the new blocks.
+    std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> footer{};
+    file.pread(std::as_writable_bytes(std::span{footer}), end - footer.size());
+    lzma_stream_flags flags{};
+    if (lzma_stream_footer_decode(&flags, footer.data()) != LZMA_OK ||
+        flags.backward_size > end - footer.size() - offset_) {
+      throw Exception("Bad Footer");
+    }
+    const std::size_t blocks_end = end - footer.size() - flags.backward_size;
+    thes::DynamicBuffer buf{};
+    buf.resize(flags.backward_size);
+    file.pread(std::span{buf.data(), buf.size()}, blocks_end);
+    lzma_index* raw_new{};
+    std::uint64_t memlimit = UINT64_MAX;
+    std::size_t in_pos = 0;
+    if (lzma_index_buffer_decode(&raw_new, &memlimit, nullptr, buf.data_u8(), &in_pos,
+                                 buf.size()) != LZMA_OK) {
+      throw Exception("Error decoding the index of the new blocks");
+    }
+    const IndexPtr new_index{raw_new};
+
+    // Merge the old and the new blocks into a single index.
+    const IndexPtr index{lzma_index_init(nullptr)};
+    if (index == nullptr) {
+      throw Exception("Allocating an index failed!");
+    }
+    const auto append = [&](lzma_vli unpadded_size, lzma_vli uncompressed_size) {
+      if (lzma_index_append(index.get(), nullptr, unpadded_size, uncompressed_size) != LZMA_OK) {
+        throw Exception("Error appending to the index");
+      }
+    };
+    for (const auto& [unpadded_size, uncompressed_size] : records_) {
+      append(unpadded_size, uncompressed_size);
+    }
+    lzma_index_iter it{};
+    lzma_index_iter_init(&it, new_index.get());
+    while (lzma_index_iter_next(&it, LZMA_INDEX_ITER_BLOCK) == 0) {
+      append(it.block.unpadded_size, it.block.uncompressed_size);
+    }
+
+    // Write the index and the footer after the new blocks.
+    buf.resize(lzma_index_size(index.get()) + LZMA_STREAM_HEADER_SIZE);
+    std::size_t out_pos = 0;
+    if (lzma_index_buffer_encode(index.get(), buf.data_u8(), &out_pos, buf.size()) != LZMA_OK) {
+      throw Exception("Error encoding the index");
+    }
+    flags_.backward_size = lzma_index_size(index.get());
+    if (lzma_stream_footer_encode(&flags_, buf.data_u8() + out_pos) != LZMA_OK) {
+      throw Exception("Error encoding the footer");
+    }
+    file.pwrite(std::span{buf.data(), buf.size()}, blocks_end);
+    file.truncate(blocks_end + buf.size());
+    file.sync();
+
+    std::filesystem::remove(append_journal_path(path_));
+    sync_directory(std::filesystem::absolute(path_).parent_path());
+  }
+
+private:
+  struct IndexDeleter {
+    void operator()(lzma_index* index) const {
+      lzma_index_end(index, nullptr);
+    }
+  };
+  using IndexPtr = std::unique_ptr<lzma_index, IndexDeleter>;
+
+  explicit AppendTarget(std::filesystem::path path) : path_(std::move(path)) {}
+
+  std::filesystem::path path_;
+  std::size_t offset_{0};
+  lzma_stream_flags flags_{};
+  lzma_vli stream_{0};
+  // The unpadded and uncompressed sizes of the blocks of the last stream.
+  std::vector<std::pair<lzma_vli, lzma_vli>> records_{};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_ENCODE_APPEND_HPP
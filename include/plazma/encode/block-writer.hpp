@@ -0,0 +1,302 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_ENCODE_BLOCK_WRITER_HPP
+#define INCLUDE_PLAZMA_ENCODE_BLOCK_WRITER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <lzma.h>
+
+#include "thesauros/containers.hpp"
+#include "thesauros/format.hpp"
+#include "thesauros/io.hpp"
+#include "thesauros/types.hpp"
+
+#include "plazma/base.hpp"
+#include "plazma/encode/filter-chain.hpp"
+#include "plazma/encode/split.hpp"
+
+namespace plazma {
+struct BlockWriterParams {
+  std::optional<thes::u32> preset{};
+  // The uncompressed size of each block, which defaults to the one used by liblzma.
+  std::optional<thes::u64> block_size{};
+  // The maximum number of blocks which are buffered, half of which are encoded while the other
+  // half is filled, which defaults to twice the number of threads.
+  std::optional<std::size_t> in_flight{};
+  lzma_check check{LZMA_CHECK_CRC64};
+  BlockSplit split{};
+  // The filter chain, which overrides `preset` and defaults to LZMA2 with `preset`.
+  std::optional<FilterChain> filters{};
+};
+
+// An encoder which splits the input into blocks of a fixed size and encodes batches of them on
+// the threads of a pool. As opposed to `Writer`, the output only depends on the input and the
+// parameters, but not on the number of threads, and the memory use is bounded by the number of
+// blocks in flight.
+// The blocks in flight are split into two batches: While one batch is encoded in the background,
+// the other one is filled by the caller and the batch encoded before it is written.
+template<typename TPool>
+struct BlockWriter : public thes::FileWriter {
+  BlockWriter(const std::filesystem::path& dst_path, TPool& pool, BlockWriterParams params = {})
+      : thes::FileWriter(dst_path), pool_(pool), check_(params.check),
+        chain_(std::move(params.filters).value_or(FilterChain::lzma2(params.preset))),
+        filters_(chain_.raw()),
+        splitter_(std::move(params.split),
+                  params.block_size.value_or(default_block_size(chain_.lzma_options()))),
+        index_(lzma_index_init(nullptr)) {
+    if (index_ == nullptr) {
+      throw Exception("Allocating the index failed!");
+    }
+    jobs_.resize(params.in_flight.value_or(2 * pool.thread_num()));
+    if (jobs_.empty()) {
+      throw Exception("The number of blocks in flight must be positive!");
+    }
+    batch_num_ = std::min<std::size_t>(jobs_.size(), 2);
+
+    std::array<thes::u8, LZMA_STREAM_HEADER_SIZE> header{};
+    lzma_stream_flags flags{};
+    flags.check = check_;
+    if (const lzma_ret ret = lzma_stream_header_encode(&flags, header.data()); ret != LZMA_OK) {
+      throw Exception(fmt::format("Error encoding the stream header: {}", ret));
+    }
+    write_output(std::span{header.data(), header.size()});
+  }
+
+  BlockWriter(const BlockWriter&) = delete;
+  BlockWriter(BlockWriter&&) = delete;
+  BlockWriter& operator=(const BlockWriter&) = delete;
+  BlockWriter& operator=(BlockWriter&&) = delete;
+
+  // Finishes the stream if this has not been done explicitly.
+  // Since errors cannot be reported from here, call `finish` to observe them.
+  ~BlockWriter() {
+    if (!finished_) {
+      try {
+        finish();
+      } catch (const std::exception& /*e*/) {
+      }
+    }
+    if (encoder_.joinable()) {
+      encoder_.join();
+    }
+    lzma_index_end(index_, nullptr);
+  }
+
+  template<typename T>
+  requires std::is_trivial_v<std::remove_const_t<T>>
+  void write(std::span<T> span) {
+    assert(!finished_);
+    auto data = std::span{reinterpret_cast<const std::byte*>(span.data()), span.size_bytes()};
+    counters_.input(data.size());
+    while (!data.empty()) {
+      Job& job = jobs_[batch_begin(batch_) + job_num_];
+      if (job.in.size() != splitter_.max_block_size()) {
+        job.in.resize(splitter_.max_block_size());
+      }
+      const auto [num, is_end] = splitter_.next(data);
+      std::memcpy(job.in.data() + job.in_size, data.data(), num);
+      job.in_size += num;
+      data = data.subspan(num);
+
+      if (is_end && ++job_num_ == batch_begin(batch_ + 1) - batch_begin(batch_)) {
+        encode_jobs();
+      }
+    }
+  }
+
+  // Ends the current block and writes all data that has been passed to `write` so far.
+  void flush() {
+    assert(!finished_);
+    const auto first = batch_begin(batch_);
+    if (first + job_num_ < batch_begin(batch_ + 1) && jobs_[first + job_num_].in_size > 0) {
+      ++job_num_;
+    }
+    splitter_.reset();
+    encode_jobs();
+    if (const auto batch = join()) {
+      write_jobs(*batch);
+    }
+  }
+
+  // Writes all remaining data as well as the index and the footer of the stream.
+  void finish() {
+    if (finished_) {
+      return;
+    }
+    flush();
+
+    const auto index_size = lzma_index_size(index_);
+    thes::DynamicBuffer buf{};
+    buf.resize(index_size + LZMA_STREAM_HEADER_SIZE);
+    std::size_t pos = 0;
+    if (const lzma_ret ret = lzma_index_buffer_encode(index_, buf.data_u8(), &pos, index_size);
+        ret != LZMA_OK) {
+      throw Exception(fmt::format("Error encoding the index: {}", ret));
+    }
+    lzma_stream_flags flags{};
+    flags.backward_size = index_size;
+    flags.check = check_;
+    if (const lzma_ret ret = lzma_stream_footer_encode(&flags, buf.data_u8() + index_size);
+        ret != LZMA_OK) {
+      throw Exception(fmt::format("Error encoding the stream footer: {}", ret));
+    }
+    write_output(std::span{buf.data(), buf.size()});
+    finished_ = true;
+  }
+
+  [[nodiscard]] thes::u64 block_size() const {
+    return splitter_.block_size();
+  }
+  // The statistics of this writer, which are only recorded if `PLAZMA_STATS` is enabled.
+  [[nodiscard]] WriteStats stats() const {
+    return counters_.snapshot();
+  }
+
+private:
+  struct Job {
+    thes::DynamicBuffer in{};
+    std::size_t in_size{0};
+    thes::DynamicBuffer out{};
+    std::size_t out_size{0};
+    lzma_vli unpadded_size{0};
+  };
+
+  void encode_job(Job& job) {
+    job.out.resize(lzma_block_buffer_bound(job.in_size));
+    job.out_size = 0;
+
+    lzma_block block{};
+    block.version = 1;
+    block.check = check_;
+    block.filters = filters_.data();
+    const lzma_ret ret =
+      lzma_block_buffer_encode(&block, nullptr, job.in.data_u8(), job.in_size, job.out.data_u8(),
+                               &job.out_size, job.out.size());
+    if (ret != LZMA_OK) {
+      throw Exception(fmt::format("Error encoding a block: {}", ret));
+    }
+    job.unpadded_size = lzma_block_unpadded_size(&block);
+  }
+
+  template<typename T>
+  void write_output(std::span<T> data) {
+    const Stopwatch watch{};
+    thes::FileWriter::write(data);
+    counters_.output(data.size_bytes(), watch);
+  }
+
+  // A range of jobs.
+  struct Batch {
+    std::size_t first;
+    std::size_t num;
+  };
+
+  // The first job of the given batch, where `batch_begin(batch_num_)` is the number of jobs.
+  [[nodiscard]] std::size_t batch_begin(std::size_t batch) const {
+    return batch * jobs_.size() / batch_num_;
+  }
+
+  // Waits for the batch which is being encoded, starts encoding the filled jobs of the current
+  // batch in the background and writes the batch which has been waited for in the meantime.
+  void encode_jobs() {
+    const auto done = join();
+    if (job_num_ > 0) {
+      const Batch batch{.first = batch_begin(batch_), .num = job_num_};
+      encoding_ = batch;
+      encoder_ = std::thread([this, batch] {
+        try {
+          encode_batch(batch);
+        } catch (...) {
+          encode_error_ = std::current_exception();
+        }
+      });
+      batch_ = (batch_ + 1) % batch_num_;
+      job_num_ = 0;
+    }
+    if (done.has_value()) {
+      write_jobs(*done);
+    }
+    // A single batch has to be written before it can be filled again.
+    if (batch_num_ == 1) {
+      if (const auto batch = join()) {
+        write_jobs(*batch);
+      }
+    }
+  }
+
+  // Encodes the jobs of the batch in parallel.
+  void encode_batch(Batch batch) {
+    const Stopwatch watch{};
+    parallel_for(pool_, batch.num, [&](std::size_t i) { encode_job(jobs_[batch.first + i]); });
+    counters_.encode(watch);
+  }
+
+  // Waits until the batch which is being encoded, if any, is done, which the caller stalls for.
+  std::optional<Batch> join() {
+    if (!encoding_.has_value()) {
+      return std::nullopt;
+    }
+    const Stopwatch watch{};
+    encoder_.join();
+    counters_.stall(watch);
+    const auto batch = *std::exchange(encoding_, std::nullopt);
+    if (encode_error_ != nullptr) {
+      std::rethrow_exception(std::exchange(encode_error_, nullptr));
+    }
+    return batch;
+  }
+
+  // Writes the encoded jobs in order.
+  void write_jobs(Batch batch) {
+    for (std::size_t i = batch.first; i < batch.first + batch.num; ++i) {
+      Job& job = jobs_[i];
+      write_output(std::span{job.out.data(), job.out_size});
+      if (lzma_index_append(index_, nullptr, job.unpadded_size, job.in_size) != LZMA_OK) {
+        throw Exception("Error appending to the index!");
+      }
+      job.in_size = 0;
+    }
+  }
+
+  TPool& pool_;
+  lzma_check check_;
+  FilterChain chain_;
+  // References the options in `chain_`.
+  std::array<lzma_filter, LZMA_FILTERS_MAX + 1> filters_;
+  BlockSplitter splitter_;
+  lzma_index* index_;
+
+  std::vector<Job> jobs_{};
+  // The number of batches the jobs are split into, which is one if there is only one job.
+  std::size_t batch_num_{1};
+  // The batch which is being filled and the number of its jobs which are filled completely,
+  // i.e. the index of the current job within the batch.
+  std::size_t batch_{0};
+  std::size_t job_num_{0};
+  // The batch which is being encoded by `encoder_`, whose exception is stored in `encode_error_`.
+  std::optional<Batch> encoding_{};
+  std::thread encoder_{};
+  std::exception_ptr encode_error_{};
+  WriteCounters counters_{};
+  bool finished_{false};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_ENCODE_BLOCK_WRITER_HPP
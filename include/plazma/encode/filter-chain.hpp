@@ -0,0 +1,108 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_ENCODE_FILTER_CHAIN_HPP
+#define INCLUDE_PLAZMA_ENCODE_FILTER_CHAIN_HPP
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <lzma.h>
+
+#include "thesauros/types.hpp"
+
+#include "plazma/base/exception.hpp"
+
+namespace plazma {
+// A filter chain for encoding which owns the options of its filters.
+// The chain is stored in the header of each block, i.e. decoding does not require it.
+struct FilterChain {
+  using Options = std::variant<lzma_options_lzma, lzma_options_delta, lzma_options_bcj>;
+  struct Filter {
+    lzma_vli id;
+    Options options;
+  };
+
+  explicit FilterChain(std::vector<Filter> filters) : filters_(std::move(filters)) {
+    if (filters_.empty() || filters_.size() > LZMA_FILTERS_MAX) {
+      throw Exception("A filter chain needs between one and four filters!");
+    }
+    if (filters_.back().id != LZMA_FILTER_LZMA2) {
+      throw Exception("The last filter has to be LZMA2!");
+    }
+  }
+
+  static Filter lzma2_filter(std::optional<thes::u32> preset = {}) {
+    lzma_options_lzma opt{};
+    if (lzma_lzma_preset(&opt, preset.value_or(LZMA_PRESET_DEFAULT)) != 0) {
+      throw Exception("Getting preset failed!");
+    }
+    return {.id = LZMA_FILTER_LZMA2, .options = opt};
+  }
+  static Filter delta_filter(thes::u32 distance) {
+    if (distance < LZMA_DELTA_DIST_MIN || distance > LZMA_DELTA_DIST_MAX) {
+      throw Exception("Invalid delta distance!");
+    }
+    lzma_options_delta opt{};
+    opt.type = LZMA_DELTA_TYPE_BYTE;
+    opt.dist = distance;
+    return {.id = LZMA_FILTER_DELTA, .options = opt};
+  }
+  // A branch/call/jump filter for executables, e.g. `LZMA_FILTER_X86` or `LZMA_FILTER_ARM64`.
+  static Filter bcj_filter(lzma_vli id) {
+    return {.id = id, .options = lzma_options_bcj{}};
+  }
+
+  // Only LZMA2, which is the default.
+  static FilterChain lzma2(std::optional<thes::u32> preset = {}) {
+    return FilterChain{{lzma2_filter(preset)}};
+  }
+  // Delta encoding with the size of `T` as distance followed by LZMA2, which compresses arrays
+  // of slowly changing numbers, e.g. sensor data, better than LZMA2 alone.
+  template<typename T>
+  static FilterChain delta(std::optional<thes::u32> preset = {}) {
+    return FilterChain{{delta_filter(sizeof(T)), lzma2_filter(preset)}};
+  }
+  static FilterChain bcj(lzma_vli id, std::optional<thes::u32> preset = {}) {
+    return FilterChain{{bcj_filter(id), lzma2_filter(preset)}};
+  }
+  // The preset for arrays of the given element type, i.e. delta encoding for multi-byte
+  // arithmetic types and LZMA2 alone otherwise.
+  template<typename T>
+  static FilterChain for_type(std::optional<thes::u32> preset = {}) {
+    if constexpr (std::is_arithmetic_v<T> && sizeof(T) > 1) {
+      return delta<T>(preset);
+    } else {
+      return lzma2(preset);
+    }
+  }
+
+  // The chain in the format used by liblzma, which references the options of this object.
+  [[nodiscard]] std::array<lzma_filter, LZMA_FILTERS_MAX + 1> raw() {
+    std::array<lzma_filter, LZMA_FILTERS_MAX + 1> out{};
+    for (std::size_t i = 0; i < filters_.size(); ++i) {
+      out[i].id = filters_[i].id;
+      out[i].options = std::visit([](auto& opt) -> void* { return &opt; }, filters_[i].options);
+    }
+    out[filters_.size()] = {.id = LZMA_VLI_UNKNOWN, .options = nullptr};
+    return out;
+  }
+
+  [[nodiscard]] const lzma_options_lzma& lzma_options() const {
+    return std::get<lzma_options_lzma>(filters_.back().options);
+  }
+
+private:
+  std::vector<Filter> filters_;
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_ENCODE_FILTER_CHAIN_HPP
@@ -0,0 +1,119 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_ENCODE_SPLIT_HPP
+#define INCLUDE_PLAZMA_ENCODE_SPLIT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include <lzma.h>
+
+#include "thesauros/types.hpp"
+
+#include "plazma/base/exception.hpp"
+
+namespace plazma {
+// The block size used by liblzma if none is given.
+inline thes::u64 default_block_size(const lzma_options_lzma& opt) {
+  return std::max<thes::u64>(thes::u64{3} * opt.dict_size, thes::u64{1} << 20);
+}
+
+// Determines where blocks end, which allows records to be kept within a single block.
+struct BlockSplit {
+  // Blocks end at multiples of this number of bytes, e.g. the size of an element type.
+  std::size_t align{1};
+  // If given, a block which has reached the block size is extended up to the first boundary
+  // found by this function. It is called on consecutive pieces of the data following the
+  // block size and returns the number of bytes in the given piece up to the boundary, if any.
+  std::function<std::optional<std::size_t>(std::span<const std::byte>)> boundary{};
+  // The size at which a block which is extended is ended regardless of boundaries,
+  // which defaults to twice the block size.
+  std::optional<thes::u64> max_block_size{};
+
+  template<typename T>
+  static BlockSplit aligned() {
+    return {.align = sizeof(T)};
+  }
+  // Blocks end after the first occurrence of the given byte following the block size,
+  // e.g. after the first newline.
+  static BlockSplit after(std::byte delim) {
+    return {.boundary = [delim](std::span<const std::byte> data) -> std::optional<std::size_t> {
+      const auto it = std::find(data.begin(), data.end(), delim);
+      if (it == data.end()) {
+        return std::nullopt;
+      }
+      return it - data.begin() + 1;
+    }};
+  }
+
+  [[nodiscard]] bool is_trivial() const {
+    return align == 1 && !boundary;
+  }
+  // The block size rounded down to the alignment.
+  [[nodiscard]] thes::u64 aligned_block_size(thes::u64 block_size) const {
+    return std::max<thes::u64>(block_size / align * align, align);
+  }
+};
+
+// Splits a sequence of chunks into blocks according to a `BlockSplit`.
+struct BlockSplitter {
+  BlockSplitter(BlockSplit split, thes::u64 block_size)
+      : split_(std::move(split)), block_size_(split_.aligned_block_size(block_size)),
+        max_block_size_(split_.boundary ? split_.max_block_size.value_or(2 * block_size_)
+                                        : block_size_) {
+    if (block_size == 0 || split_.align == 0 || max_block_size_ < block_size_) {
+      throw Exception("Invalid block split!");
+    }
+  }
+
+  // Returns the number of bytes at the start of `data` which belong to the current block and
+  // whether the block ends after them.
+  std::pair<std::size_t, bool> next(std::span<const std::byte> data) {
+    std::size_t num = 0;
+    bool is_end = false;
+    if (fill_ < block_size_) {
+      num = std::min<std::size_t>(block_size_ - fill_, data.size());
+    } else {
+      const auto piece = data.first(std::min<std::size_t>(max_block_size_ - fill_, data.size()));
+      const auto boundary = split_.boundary(piece);
+      num = boundary.value_or(piece.size());
+      is_end = boundary.has_value();
+    }
+
+    fill_ += num;
+    if (is_end || fill_ == max_block_size_) {
+      fill_ = 0;
+      return {num, true};
+    }
+    return {num, false};
+  }
+
+  // Starts a new block, e.g. after a block has been ended by a flush.
+  void reset() {
+    fill_ = 0;
+  }
+
+  [[nodiscard]] thes::u64 block_size() const {
+    return block_size_;
+  }
+  [[nodiscard]] thes::u64 max_block_size() const {
+    return max_block_size_;
+  }
+
+private:
+  BlockSplit split_;
+  thes::u64 block_size_;
+  thes::u64 max_block_size_;
+  thes::u64 fill_{0};
+};
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_ENCODE_SPLIT_HPP
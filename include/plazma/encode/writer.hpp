@@ -9,60 +9,84 @@
 
 #include <algorithm>
 #include <array>
+#include <cassert>
 #include <cstdint>
 #include <cstdio>
+#include <exception>
 #include <filesystem>
 #include <optional>
 #include <span>
 #include <type_traits>
+#include <utility>
 
 #include <lzma.h>
 
 #include "thesauros/format.hpp"
-#include "thesauros/io.hpp"
 #include "thesauros/macropolis.hpp"
 #include "thesauros/types.hpp"
 
 #include "plazma/base.hpp"
+#include "plazma/encode/append.hpp"
+#include "plazma/encode/filter-chain.hpp"
+#include "plazma/encode/split.hpp"
 
 namespace plazma {
 struct WriterParams {
   const std::optional<thes::u32> preset{};
   std::optional<thes::u64> block_size{};
   std::optional<thes::u32> thread_num{};
+  BlockSplit split{};
+  // The filter chain, which overrides `preset` and defaults to LZMA2 with `preset`.
+  std::optional<FilterChain> filters{};
+  // Append the new blocks to the last stream of the file if it exists instead of overwriting it,
+  // which only rewrites its index. The new blocks use the integrity check of that stream.
+  bool append{false};
 };
 
 // Based on doc/04_compress_easy_mt.c
-struct Writer : public thes::FileWriter {
+struct Writer {
   static constexpr std::size_t io_buffer_size = (BUFSIZ <= 1024) ? 8192 : (BUFSIZ & ~7U);
   using IoBuf = std::array<uint8_t, io_buffer_size>;
 
   explicit Writer(const std::filesystem::path& dst_path, WriterParams params = {})
-      : thes::FileWriter(dst_path) {
-    lzma_options_lzma opt_lzma{};
-    if (lzma_lzma_preset(&opt_lzma, params.preset.value_or(LZMA_PRESET_DEFAULT)) != 0) {
-      throw Exception("Getting preset failed!");
+      : append_(prepare_output(dst_path, params.append)),
+        file_(dst_path,
+              append_.has_value() ? OutputFile::Mode::update : OutputFile::Mode::truncate),
+        off_(append_.has_value() ? append_->offset() : 0),
+        skip_(append_.has_value() ? LZMA_STREAM_HEADER_SIZE : 0) {
+    FilterChain chain = params.filters.value_or(FilterChain::lzma2(params.preset));
+    std::array<lzma_filter, LZMA_FILTERS_MAX + 1> filters = chain.raw();
+    const lzma_options_lzma& opt_lzma = chain.lzma_options();
+
+    // Aligned blocks only require an aligned block size, while boundaries which are not at
+    // fixed offsets are inserted using barriers, for which the encoder’s own block size has to
+    // be the maximum block size.
+    thes::u64 block_size = params.block_size.value_or(0);
+    if (params.split.boundary) {
+      splitter_.emplace(std::move(params.split),
+                        params.block_size.value_or(default_block_size(opt_lzma)));
+      block_size = splitter_->max_block_size();
+    } else if (!params.split.is_trivial()) {
+      block_size =
+        params.split.aligned_block_size(params.block_size.value_or(default_block_size(opt_lzma)));
     }
 
-    std::array<lzma_filter, LZMA_FILTERS_MAX + 1> filters{{
-      {.id = LZMA_FILTER_LZMA2, .options = &opt_lzma},
-      {.id = LZMA_VLI_UNKNOWN, .options = nullptr},
-    }};
-
     THES_POLIS_DIAGNOSTICS_IGNORED_PUSH(gcc, "-Wmissing-field-initializers")
     const lzma_mt mt{
       .flags = 0,
       .threads = params.thread_num.value_or(lzma_cputhreads()),
-      .block_size = params.block_size.value_or(0),
+      .block_size = block_size,
       .timeout = 0,
       .filters = filters.data(),
-      .check = LZMA_CHECK_CRC64,
+      .check = append_.has_value() ? append_->check() : LZMA_CHECK_CRC64,
     };
     THES_POLIS_DIAGNOSTICS_IGNORED_POP(gcc)
 
     if (const lzma_ret ret = lzma_stream_encoder_mt(&strm_, &mt); ret != LZMA_OK) {
       throw Exception(fmt::format("Error {}", ret));
     }
+    strm_.next_out = out_buf_.data();
+    strm_.avail_out = out_buf_.size();
   }
 
   Writer(const Writer&) = delete;
@@ -70,53 +94,135 @@ struct Writer : public thes::FileWriter {
   Writer& operator=(const Writer&) = delete;
   Writer& operator=(Writer&&) = delete;
 
+  // Finishes the stream if this has not been done explicitly.
+  // Since errors cannot be reported from here, call `finish` to observe them.
   ~Writer() {
+    if (!finished_) {
+      try {
+        finish();
+      } catch (const std::exception& /*e*/) {
+      }
+    }
     lzma_end(&strm_);
   }
 
+  // Encodes the given data, which can be called any number of times before `finish`.
+  // Only complete output buffers are written, i.e. the memory use is independent of the size.
   template<typename T>
   requires std::is_trivial_v<std::remove_const_t<T>>
   void write(std::span<T> span) {
-    const auto* current = reinterpret_cast<const thes::u8*>(span.data());
-    const auto* end = current + span.size_bytes();
-    IoBuf out_buf{};
-    strm_.next_out = out_buf.data();
-    strm_.avail_out = out_buf.size();
-
-    lzma_action action = (current == end) ? LZMA_FINISH : LZMA_RUN;
-
-    while (true) {
-      if (strm_.avail_in == 0 && action == LZMA_RUN) {
-        strm_.next_in = current;
-        const auto read_size =
-          std::min(*thes::safe_cast<std::size_t>(end - current), io_buffer_size);
-        strm_.avail_in = read_size;
-        current += read_size;
-
-        if (current == end) {
-          action = LZMA_FINISH;
+    assert(!finished_);
+    auto data = std::span{reinterpret_cast<const thes::u8*>(span.data()), span.size_bytes()};
+    counters_.input(data.size());
+    if (!splitter_.has_value()) {
+      encode(data);
+      return;
+    }
+    while (!data.empty()) {
+      const auto [num, is_end] = splitter_->next(std::as_bytes(data));
+      encode(data.first(num));
+      data = data.subspan(num);
+      if (is_end) {
+        while (code(LZMA_FULL_BARRIER) != LZMA_STREAM_END) {
         }
       }
+    }
+  }
 
-      const lzma_ret ret = lzma_code(&strm_, action);
-
-      if (strm_.avail_out == 0 || ret == LZMA_STREAM_END) {
-        thes::FileWriter::write(std::span{out_buf.data(), out_buf.size() - strm_.avail_out});
-        strm_.next_out = out_buf.data();
-        strm_.avail_out = out_buf.size();
-      }
+  // Ends the current block and writes all data that has been passed to `write` so far.
+  void flush() {
+    assert(!finished_);
+    while (code(LZMA_FULL_FLUSH) != LZMA_STREAM_END) {
+    }
+    if (splitter_.has_value()) {
+      splitter_->reset();
+    }
+  }
 
-      if (ret == LZMA_STREAM_END && current == end) {
-        break;
-      }
-      if (ret != LZMA_OK) {
-        throw Exception(fmt::format("Error {}", ret));
-      }
+  // Writes all remaining data as well as the index and the footer of the stream.
+  // When appending, the index and the footer of the encoder are replaced by an index of all
+  // blocks of the last stream, which is written durably before the journal is removed.
+  void finish() {
+    if (finished_) {
+      return;
     }
+    while (code(LZMA_FINISH) != LZMA_STREAM_END) {
+    }
+    if (append_.has_value()) {
+      append_->complete(file_, off_);
+    }
+    finished_ = true;
+  }
+
+  // The statistics of this writer, which are only recorded if `PLAZMA_STATS` is enabled.
+  [[nodiscard]] WriteStats stats() const {
+    return counters_.snapshot();
   }
 
 private:
+  static std::optional<AppendTarget> prepare_output(const std::filesystem::path& dst_path,
+                                                    bool append) {
+    if (append) {
+      return AppendTarget::prepare(dst_path);
+    }
+    // The journal of an interrupted append does not apply to the file which replaces it.
+    discard_append_journal(dst_path);
+    return std::nullopt;
+  }
+
+  void encode(std::span<const thes::u8> data) {
+    strm_.next_in = data.data();
+    strm_.avail_in = data.size();
+    while (strm_.avail_in > 0) {
+      code(LZMA_RUN);
+    }
+  }
+
+  lzma_ret code(lzma_action action) {
+    const auto avail_in = strm_.avail_in;
+    const Stopwatch encode_watch{};
+    const lzma_ret ret = lzma_code(&strm_, action);
+    counters_.encode(encode_watch);
+    // Without consuming input, the call has only waited for the threads of the encoder.
+    if (strm_.avail_in == avail_in) {
+      counters_.stall(encode_watch);
+    }
+
+    if (strm_.avail_out == 0 || ret == LZMA_STREAM_END) {
+      const Stopwatch write_watch{};
+      const std::size_t size = out_buf_.size() - strm_.avail_out;
+      write_output(std::as_bytes(std::span{out_buf_.data(), size}));
+      counters_.output(size, write_watch);
+      strm_.next_out = out_buf_.data();
+      strm_.avail_out = out_buf_.size();
+    }
+
+    if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+      throw Exception(fmt::format("Error {}", ret));
+    }
+    return ret;
+  }
+
+  void write_output(std::span<const std::byte> data) {
+    // When appending, the header of the encoder’s stream is dropped.
+    const auto skip = std::min(skip_, data.size());
+    skip_ -= skip;
+    data = data.subspan(skip);
+    file_.pwrite(data, off_);
+    off_ += data.size();
+  }
+
+  std::optional<AppendTarget> append_;
+  OutputFile file_;
+  // The offset at which the next output is written.
+  std::size_t off_;
+  // The number of bytes at the start of the output which are not written.
+  std::size_t skip_;
   lzma_stream strm_ = LZMA_STREAM_INIT;
+  IoBuf out_buf_{};
+  std::optional<BlockSplitter> splitter_{};
+  WriteCounters counters_{};
+  bool finished_{false};
 };
 } // namespace plazma
 
@@ -5,6 +5,7 @@
 #include "base.hpp"
 #include "decode.hpp"
 #include "encode.hpp"
+#include "reblock.hpp"
 // IWYU pragma: end_exports
 
 #endif // INCLUDE_PLAZMA_PLAZMA_HPP
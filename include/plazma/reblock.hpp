@@ -0,0 +1,31 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef INCLUDE_PLAZMA_REBLOCK_HPP
+#define INCLUDE_PLAZMA_REBLOCK_HPP
+
+#include <filesystem>
+#include <utility>
+
+#include "plazma/decode.hpp"
+#include "plazma/encode.hpp"
+
+namespace plazma {
+// Converts an XZ file, e.g. one consisting of a single block, into one split into blocks of the
+// size given in `params`, which allows segments of it to be loaded efficiently.
+// The file is decoded in a single pass on the calling thread and the decoded chunks are passed
+// on to the multithreaded encoder of `Writer`, which encodes blocks in parallel with decoding.
+// Neither the input nor the output is held in memory as a whole.
+inline void reblock(const std::filesystem::path& src_path, const std::filesystem::path& dst_path,
+                    WriterParams params = {}) {
+  Reader reader{src_path};
+  Writer writer{dst_path, std::move(params)};
+  reader.decompress(writer);
+  writer.finish();
+}
+} // namespace plazma
+
+#endif // INCLUDE_PLAZMA_REBLOCK_HPP
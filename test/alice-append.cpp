@@ -0,0 +1,144 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include <lzma.h>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+namespace {
+std::string read_file(const std::filesystem::path& path) {
+  thes::FileReader reader{path};
+  const auto size = reader.size();
+  std::string str(size, '\0');
+  reader.pread(std::span{str.data(), size}, 0);
+  return str;
+}
+} // namespace
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice-append.md.xz";
+  const auto journal_path = plazma::append_journal_path(xz_path);
+
+  const std::string md_str = read_file(md_path);
+  const std::string_view md{md_str};
+  const std::size_t half = md.size() / 2;
+
+  const auto check = [&](std::string_view expected) {
+    plazma::Reader reader{xz_path};
+    std::cout << "blocks: " << reader.block_count() << ", size: " << reader.size() << '\n';
+    THES_ASSERT(lzma_index_stream_count(reader.index()->raw()) == 1);
+    THES_ASSERT(reader.uncompressed_size() == expected.size());
+    std::string str(expected.size(), '\0');
+    reader.load_segment(0, std::span{str.data(), str.size()});
+    THES_ASSERT(str == expected);
+    thes::FixedStdThreadPool pool(2);
+    THES_ASSERT(reader.verify(pool).ok());
+    THES_ASSERT(!std::filesystem::exists(journal_path));
+  };
+
+  // Appending to a file which does not exist creates it
+  std::filesystem::remove(xz_path);
+  {
+    plazma::Writer writer{xz_path, {.block_size = 4096, .thread_num = 2, .append = true}};
+    writer.write(std::span{md.data(), half});
+    writer.finish();
+  }
+  check(md.substr(0, half));
+
+  // The new blocks are added to the existing stream
+  {
+    plazma::Writer writer{xz_path, {.block_size = 4096, .thread_num = 2, .append = true}};
+    writer.write(std::span{md.data() + half, md.size() - half});
+    writer.finish();
+  }
+  check(md);
+  {
+    plazma::Reader reader{xz_path};
+    THES_ASSERT(reader.block_count() == (half + 4095) / 4096 + (md.size() - half + 4095) / 4096);
+  }
+
+  // Appending nothing keeps the data
+  {
+    plazma::Writer writer{xz_path, {.append = true}};
+    writer.finish();
+  }
+  check(md);
+
+  // An interrupted append is rolled back using the journal
+  const std::string before = read_file(xz_path);
+  {
+    const auto target = plazma::AppendTarget::prepare(xz_path);
+    THES_ASSERT(target.has_value());
+    THES_ASSERT(std::filesystem::exists(journal_path));
+    // Simulate partially written blocks which have overwritten the index
+    const plazma::OutputFile file{xz_path, plazma::OutputFile::Mode::update};
+    const std::string garbage(1000, 'x');
+    file.pwrite(std::as_bytes(std::span{garbage}), target->offset());
+  }
+  THES_ASSERT(read_file(xz_path) != before);
+  THES_ASSERT(plazma::recover_append(xz_path));
+  THES_ASSERT(!plazma::recover_append(xz_path));
+  THES_ASSERT(read_file(xz_path) == before);
+  check(md);
+
+  // Overwriting the file discards the journal of an interrupted append
+  {
+    plazma::Writer writer{xz_path, {.block_size = 4096}};
+    writer.write(std::span{md.data(), half});
+  }
+  THES_ASSERT(plazma::AppendTarget::prepare(xz_path).has_value());
+  THES_ASSERT(std::filesystem::exists(journal_path));
+  {
+    plazma::Writer writer{xz_path, {.block_size = 4096}};
+    writer.write(std::span{md.data(), md.size() - 1000});
+  }
+  THES_ASSERT(!std::filesystem::exists(journal_path));
+  {
+    plazma::Writer writer{xz_path, {.block_size = 4096, .append = true}};
+    writer.write(std::span{md.data() + md.size() - 1000, 1000});
+  }
+  check(md);
+
+  // A journal which does not belong to the file is not applied to it, even if the file has been
+  // replaced in place, i.e. its inode is the same
+  THES_ASSERT(plazma::AppendTarget::prepare(xz_path).has_value());
+  {
+    const auto new_path = base_path / "alice-append-new.md.xz";
+    {
+      plazma::Writer writer{new_path, {.block_size = 4096}};
+      writer.write(std::span{md.data(), half});
+    }
+    const std::string replaced = read_file(new_path);
+    std::filesystem::remove(new_path);
+    {
+      const plazma::OutputFile file{xz_path};
+      file.pwrite(std::as_bytes(std::span{replaced}), 0);
+    }
+    bool failed = false;
+    try {
+      plazma::recover_append(xz_path);
+    } catch (const plazma::Exception& /*e*/) {
+      failed = true;
+    }
+    THES_ASSERT(failed);
+    THES_ASSERT(read_file(xz_path) == replaced);
+  }
+  plazma::discard_append_journal(xz_path);
+  check(md.substr(0, half));
+
+  std::filesystem::remove(xz_path);
+}
@@ -0,0 +1,80 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice-block.md.xz";
+
+  thes::FileReader md_reader{md_path};
+  const auto md_size = md_reader.size();
+  std::string md_str(md_size + 1, '\0');
+  md_reader.pread(std::span{md_str.data(), md_size}, 0);
+
+  std::optional<std::string> reference{};
+  for (std::size_t thread_num = 1; thread_num <= 8; ++thread_num) {
+    thes::FixedStdThreadPool pool(thread_num);
+    {
+      plazma::BlockWriter xz_writer{xz_path, pool, {.block_size = 4096, .in_flight = thread_num}};
+      // Write in pieces which do not line up with the blocks
+      for (std::size_t off = 0; off < md_size; off += 3000) {
+        xz_writer.write(std::span{std::as_const(md_str).data() + off,
+                                  std::min<std::size_t>(3000, md_size - off)});
+      }
+    }
+
+    plazma::Reader xz_reader{xz_path};
+    std::cout << thread_num << ": block count " << xz_reader.block_count() << ", size "
+              << xz_reader.size() << '\n';
+    THES_ASSERT(xz_reader.block_count() == (md_size + 4095) / 4096);
+    THES_ASSERT(xz_reader.uncompressed_size() == md_size);
+    std::string xz_str(md_size + 1, '\0');
+    xz_reader.load_segment(0, std::span{xz_str.data(), md_size});
+    THES_ASSERT(md_str == xz_str);
+
+    // The output does not depend on the number of threads
+    std::string compressed(xz_reader.size(), '\0');
+    xz_reader.source().pread(std::as_writable_bytes(std::span{compressed}), 0);
+    if (reference.has_value()) {
+      THES_ASSERT(compressed == *reference);
+    } else {
+      reference = std::move(compressed);
+    }
+  }
+
+  // Blocks end after the first newline following the block size
+  {
+    thes::FixedStdThreadPool pool(4);
+    {
+      plazma::BlockWriter xz_writer{
+        xz_path, pool, {.block_size = 4096, .split = plazma::BlockSplit::after(std::byte{'\n'})}};
+      xz_writer.write(std::span{std::as_const(md_str).data(), md_size});
+    }
+
+    plazma::Reader xz_reader{xz_path};
+    std::cout << "line-aligned block count " << xz_reader.block_count() << '\n';
+    for (auto it = xz_reader.iter_at(0); it != xz_reader.end(); ++it) {
+      THES_ASSERT(it->usize() >= 4096 || it->uend() == md_size);
+      THES_ASSERT(md_str[it->uend() - 1] == '\n');
+    }
+    std::string xz_str(md_size + 1, '\0');
+    xz_reader.load_segment(0, std::span{xz_str.data(), md_size});
+    THES_ASSERT(md_str == xz_str);
+  }
+}
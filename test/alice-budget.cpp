@@ -0,0 +1,135 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice.md.xz";
+
+  thes::FileReader md_reader{md_path};
+  const auto md_size = md_reader.size();
+  std::string md_str(md_size + 1, '\0');
+  md_reader.pread(std::span{md_str.data(), md_size}, 0);
+
+  // A single decode at a time determines the memory required by one decode
+  std::size_t decode_size = 0;
+  std::size_t block_size = 0;
+  {
+    auto budget = std::make_shared<plazma::MemoryBudget>(std::size_t{1} << 30);
+    plazma::Reader xz_reader{xz_path, {.budget = budget}};
+    for (plazma::Block block : xz_reader) {
+      block_size = std::max<std::size_t>(block_size, block.usize());
+    }
+    std::string xz_str(md_size + 1, '\0');
+    xz_reader.load_segment(0, std::span{xz_str.data(), md_size});
+    THES_ASSERT(md_str == xz_str);
+
+    auto stats = budget->stats();
+    std::cout << "reserved: " << stats.peak_reserved << ", allocated: " << stats.peak_allocated
+              << ", allocations: " << stats.allocations << '\n';
+    THES_ASSERT(stats.peak_allocated > 0);
+    THES_ASSERT(stats.peak_reserved > 0);
+    THES_ASSERT(stats.peak_buffers == 0);
+    // The decoder keeps its state for all blocks instead of allocating it for each of them
+    THES_ASSERT(stats.allocations < xz_reader.block_count());
+    THES_ASSERT(stats.reserved == stats.peak_reserved);
+    THES_ASSERT(stats.allocated > 0);
+    decode_size = stats.peak_reserved;
+
+    // Unused decoders return their memory once they are freed
+    xz_reader.decoders().clear();
+    stats = budget->stats();
+    THES_ASSERT(stats.reserved == 0);
+    THES_ASSERT(stats.allocated == 0);
+  }
+
+  // Only one decode fits into the budget, regardless of the number of threads, while the idle
+  // decoders of other threads are reclaimed and the fetched blocks are admitted as well
+  for (std::size_t limit : {decode_size + decode_size / 2, decode_size + 4 * block_size}) {
+    for (std::size_t thread_num = 1; thread_num <= 8; ++thread_num) {
+      auto budget = std::make_shared<plazma::MemoryBudget>(limit);
+      plazma::Reader xz_reader{xz_path, {.budget = budget}};
+      thes::FixedStdThreadPool pool(thread_num);
+      std::string str(md_size + 1, '\0');
+      xz_reader.load_segment(0, std::span{str.data(), md_size}, pool);
+      THES_ASSERT(md_str == str);
+
+      const auto stats = budget->stats();
+      THES_ASSERT(stats.peak_reserved <= limit);
+      THES_ASSERT(stats.buffers == 0);
+      THES_ASSERT(limit == decode_size + decode_size / 2 || stats.peak_buffers > 0);
+      xz_reader.decoders().clear();
+      THES_ASSERT(budget->stats().reserved == 0);
+      THES_ASSERT(budget->stats().allocated == 0);
+    }
+  }
+
+  // Cached blocks are admitted while they are decoded
+  {
+    const std::size_t limit = decode_size + 2 * block_size;
+    auto budget = std::make_shared<plazma::MemoryBudget>(limit);
+    plazma::Reader xz_reader{
+      xz_path, {.cache = std::make_shared<plazma::BlockCache>(md_size), .budget = budget}};
+    thes::FixedStdThreadPool pool(4);
+    std::string str(md_size + 1, '\0');
+    xz_reader.load_segment(0, std::span{str.data(), md_size}, pool);
+    THES_ASSERT(md_str == str);
+
+    const auto stats = budget->stats();
+    THES_ASSERT(stats.peak_reserved <= limit);
+    THES_ASSERT(stats.peak_buffers >= block_size);
+    THES_ASSERT(stats.buffers == 0);
+  }
+
+  // The blocks of a block stream are admitted until they are released
+  for (std::size_t window = 1; window <= 8; window *= 2) {
+    const std::size_t limit = decode_size + 2 * block_size;
+    auto budget = std::make_shared<plazma::MemoryBudget>(limit);
+    plazma::Reader xz_reader{xz_path, {.budget = budget}};
+    std::string str{};
+    {
+      plazma::BlockStream stream{xz_reader, {.thread_num = 4, .window = window}};
+      while (auto block = stream.next()) {
+        const auto data = block->data();
+        str.append(reinterpret_cast<const char*>(data.data()), data.size());
+        THES_ASSERT(budget->stats().buffers >= data.size());
+      }
+    }
+    THES_ASSERT(md_str.substr(0, md_size) == str);
+
+    const auto stats = budget->stats();
+    THES_ASSERT(stats.peak_reserved <= limit);
+    THES_ASSERT(stats.peak_buffers >= block_size);
+    THES_ASSERT(stats.buffers == 0);
+    THES_ASSERT(stats.reserved == 0);
+  }
+
+  // A budget which cannot admit a single decode
+  {
+    auto budget = std::make_shared<plazma::MemoryBudget>(decode_size - 1);
+    plazma::Reader xz_reader{xz_path, {.budget = budget}};
+    std::string str(md_size + 1, '\0');
+    bool failed = false;
+    try {
+      xz_reader.load_segment(0, std::span{str.data(), md_size});
+    } catch (const plazma::Exception& /*e*/) {
+      failed = true;
+    }
+    THES_ASSERT(failed);
+  }
+}
@@ -0,0 +1,68 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice.md.xz";
+
+  thes::FileReader md_reader{md_path};
+  const auto md_size = md_reader.size();
+  std::string md_str(md_size + 1, '\0');
+  md_reader.pread(std::span{md_str.data(), md_size}, 0);
+
+  // Large enough to hold the whole file
+  {
+    auto cache = std::make_shared<plazma::BlockCache>(std::size_t{1} << 20);
+    plazma::Reader xz_reader{xz_path, {.cache = cache}};
+    const auto xz_size = xz_reader.uncompressed_size();
+    const auto block_count = xz_reader.block_count();
+
+    for (std::size_t i = 0; i < 2; ++i) {
+      std::string xz_str(xz_size + 1, '\0');
+      xz_reader.load_segment(0, std::span{xz_str.data(), xz_size});
+      THES_ASSERT(md_str == xz_str);
+    }
+
+    const auto stats = cache->stats();
+    std::cout << "hits: " << stats.hits << ", misses: " << stats.misses << '\n';
+    THES_ASSERT(stats.misses == block_count);
+    THES_ASSERT(stats.hits == block_count);
+    THES_ASSERT(stats.evictions == 0);
+    THES_ASSERT(stats.bytes == xz_size);
+  }
+
+  // Shared among threads and too small to hold the whole file
+  for (std::size_t thread_num = 1; thread_num <= 8; ++thread_num) {
+    auto cache = std::make_shared<plazma::BlockCache>(std::size_t{1} << 14);
+    std::string str(md_size + 1, '\0');
+
+    thes::FixedStdThreadPool pool(thread_num);
+    thes::UniformIndexSegmenter seg{md_size, pool.thread_num()};
+    pool.execute([&](const std::size_t idx) {
+      plazma::Reader reader{xz_path, {.cache = cache}};
+      const auto iota = seg.segment_range(idx);
+      const auto begin = iota.begin_value();
+      reader.load_segment(begin, std::span{str.data() + begin, iota.size()});
+    });
+
+    THES_ASSERT(md_str == str);
+    const auto stats = cache->stats();
+    THES_ASSERT(stats.bytes <= cache->capacity());
+    THES_ASSERT(stats.hits + stats.misses >= plazma::Reader{xz_path}.block_count());
+  }
+}
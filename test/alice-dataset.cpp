@@ -0,0 +1,72 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice.md.xz";
+  const auto empty_path = base_path / "empty.xz";
+
+  thes::FileReader md_reader{md_path};
+  const auto md_size = md_reader.size();
+  std::string md_str(md_size, '\0');
+  md_reader.pread(std::span{md_str.data(), md_size}, 0);
+
+  {
+    plazma::Writer writer{empty_path};
+    writer.finish();
+  }
+
+  // Three copies with an empty shard in between
+  const std::vector<std::filesystem::path> paths{xz_path, xz_path, empty_path, xz_path};
+  const std::string expected = md_str + md_str + md_str;
+
+  plazma::Dataset dataset{paths, {.max_open = 2}};
+  std::cout << "shards: " << dataset.shard_count() << ", size: " << dataset.uncompressed_size()
+            << '\n';
+  THES_ASSERT(dataset.shard_count() == 4);
+  THES_ASSERT(dataset.uncompressed_size() == expected.size());
+
+  const auto located = dataset.locate(2 * md_size + 5);
+  THES_ASSERT(located.shard == 3 && located.offset == 5);
+  THES_ASSERT(dataset.locate(md_size - 1).shard == 0);
+
+  std::string all(expected.size(), '\0');
+  dataset.load_segment(0, std::span{all.data(), all.size()});
+  THES_ASSERT(all == expected);
+  THES_ASSERT(dataset.readers().size() <= 2);
+
+  // Segments across shard boundaries, both serial and parallel
+  for (std::size_t thread_num = 1; thread_num <= 4; ++thread_num) {
+    thes::FixedStdThreadPool pool(thread_num);
+    const std::size_t begin = md_size / 2;
+    std::string part(2 * md_size, '\0');
+    dataset.load_segment(begin, std::span{part.data(), part.size()}, pool);
+    THES_ASSERT(part == expected.substr(begin, part.size()));
+
+    std::string par_all(expected.size(), '\0');
+    dataset.load_segment(0, std::span{par_all.data(), par_all.size()}, pool);
+    THES_ASSERT(par_all == expected);
+    THES_ASSERT(dataset.readers().size() <= 2);
+  }
+
+  std::string serial(md_size, '\0');
+  dataset.load_segment(md_size / 2, std::span{serial.data(), serial.size()});
+  THES_ASSERT(serial == expected.substr(md_size / 2, md_size));
+
+  std::filesystem::remove(empty_path);
+}
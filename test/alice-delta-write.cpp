@@ -0,0 +1,60 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto xz_path = base_path / "alice-delta.xz";
+
+  // A slowly changing signal, which is what delta encoding is intended for
+  std::vector<thes::u32> data(1U << 18U);
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<thes::u32>(1000000 + 3 * i + (i * i) % 7);
+  }
+
+  const auto compress = [&](std::optional<plazma::FilterChain> filters) {
+    {
+      plazma::Writer xz_writer{xz_path, {.block_size = 1U << 16U, .filters = std::move(filters)}};
+      xz_writer.write(std::span{std::as_const(data)});
+    }
+
+    plazma::Reader xz_reader{xz_path};
+    std::vector<thes::u32> out(data.size());
+    THES_ASSERT(xz_reader.uncompressed_size() == data.size() * sizeof(thes::u32));
+    xz_reader.load_segment(100, std::span{out}.subspan(100));
+    xz_reader.load_segment(0, std::span{out}.first(100));
+    THES_ASSERT(out == data);
+    return xz_reader.size();
+  };
+
+  const auto plain_size = compress(std::nullopt);
+  const auto delta_size = compress(plazma::FilterChain::for_type<thes::u32>());
+  std::cout << "plain: " << plain_size << ", delta: " << delta_size << '\n';
+  THES_ASSERT(delta_size < plain_size);
+
+  // The block writer supports the same filter chains
+  thes::FixedStdThreadPool pool(4);
+  {
+    plazma::BlockWriter xz_writer{
+      xz_path, pool, {.block_size = 1U << 16U, .filters = plazma::FilterChain::delta<thes::u32>()}};
+    xz_writer.write(std::span{std::as_const(data)});
+  }
+  plazma::Reader xz_reader{xz_path};
+  std::vector<thes::u32> out(data.size());
+  xz_reader.load_segment(0, std::span{out}, pool);
+  THES_ASSERT(out == data);
+}
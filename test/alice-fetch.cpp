@@ -0,0 +1,81 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  static_assert(plazma::stats_enabled);
+
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice.md.xz";
+
+  thes::FileReader md_reader{md_path};
+  const auto md_size = md_reader.size();
+  std::string md_str(md_size + 1, '\0');
+  md_reader.pread(std::span{md_str.data(), md_size}, 0);
+
+  // Decoding on a pool reads each block with a single read, with and without io_uring.
+  bool has_io_uring = true;
+  for (const bool io_uring : {false, true}) {
+    const plazma::FetchParams fetch{.depth = 3, .io_uring = io_uring};
+    plazma::Reader reader{xz_path, {.fetch = fetch}};
+    if (io_uring && !plazma::BlockFetcher{reader.source(), fetch}.uses_io_uring()) {
+      has_io_uring = false;
+      continue;
+    }
+    std::size_t csize = 0;
+    for (plazma::Block block : reader) {
+      csize += block.csize();
+    }
+
+    const auto before = reader.stats();
+    thes::FixedStdThreadPool pool(4);
+    std::string str(md_size + 1, '\0');
+    reader.load_segment(0, std::span{str.data(), md_size}, pool);
+    THES_ASSERT(md_str == str);
+
+    const auto stats = reader.stats();
+    std::cout << "io_uring " << io_uring << ": " << stats.pread_calls - before.pread_calls
+              << " reads for " << reader.block_count() << " blocks\n";
+    THES_ASSERT(stats.pread_calls - before.pread_calls == reader.block_count());
+    THES_ASSERT(stats.pread_bytes - before.pread_bytes == csize);
+    THES_ASSERT(stats.blocks_decoded - before.blocks_decoded == reader.block_count());
+
+    // With fewer blocks than the reads in flight of all threads, each thread still decodes some.
+    std::vector<lzma_index_iter> blocks{};
+    for (auto it = reader.begin(); blocks.size() < 2 * pool.thread_num(); ++it) {
+      blocks.push_back(it.raw());
+    }
+    std::mutex mutex{};
+    std::set<std::thread::id> threads{};
+    reader.decode_blocks(pool, blocks, [&](plazma::Block /*block*/, plazma::Decoder& /*decoder*/) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{20});
+      std::lock_guard lock{mutex};
+      threads.insert(std::this_thread::get_id());
+    });
+    THES_ASSERT(threads.size() == pool.thread_num());
+  }
+
+  if (!has_io_uring) {
+    std::cout << "io_uring is not available\n";
+    // Reported as skipped by Meson.
+    return 77;
+  }
+}
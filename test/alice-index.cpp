@@ -0,0 +1,99 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <span>
+#include <string>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice.md.xz";
+  const auto multi_path = base_path / "alice-multi.md.xz";
+  const auto pzi_path = plazma::index_file_path(multi_path);
+
+  thes::FileReader md_reader{md_path};
+  const auto md_size = md_reader.size();
+  std::string md_str(md_size + 1, '\0');
+  md_reader.pread(std::span{md_str.data(), md_size}, 0);
+
+  // Two streams with stream padding in between and at the end
+  {
+    thes::DynamicBuffer xz{};
+    thes::FileReader xz_reader{xz_path};
+    xz_reader.pread(xz, xz_reader.size(), 0);
+    const std::array<std::byte, 8> padding{};
+
+    thes::FileWriter writer{multi_path};
+    writer.write(std::span{xz.data(), xz.size()});
+    writer.write(std::span{padding.data(), padding.size()});
+    writer.write(std::span{xz.data(), xz.size()});
+    writer.write(std::span{padding.data(), 4});
+  }
+  std::filesystem::remove(pzi_path);
+
+  const auto check = [&](plazma::Reader& reader) {
+    const auto size = reader.uncompressed_size();
+    THES_ASSERT(size == 2 * md_size);
+    std::string str(size, '\0');
+    reader.load_segment(0, std::span{str.data(), size});
+    THES_ASSERT(str.substr(0, md_size) == md_str.substr(0, md_size));
+    THES_ASSERT(str.substr(md_size) == md_str.substr(0, md_size));
+  };
+
+  plazma::Reader parsed{multi_path};
+  check(parsed);
+  THES_ASSERT(plazma::load_index_file(multi_path, parsed.source()) == nullptr);
+
+  {
+    plazma::Reader reader{multi_path, {.index_file = plazma::IndexFileMode::load_or_create}};
+    THES_ASSERT(std::filesystem::exists(pzi_path));
+    check(reader);
+  }
+
+  const auto loaded = plazma::load_index_file(multi_path, parsed.source());
+  THES_ASSERT(loaded != nullptr);
+  std::cout << "streams: " << lzma_index_stream_count(loaded->raw())
+            << ", blocks: " << loaded->block_count() << '\n';
+  THES_ASSERT(lzma_index_stream_count(loaded->raw()) == 2);
+  THES_ASSERT(loaded->block_count() == parsed.block_count());
+  THES_ASSERT(loaded->file_size() == parsed.size());
+  {
+    plazma::Reader reader{multi_path, loaded};
+    check(reader);
+    for (auto it = reader.iter_at(0), pit = parsed.iter_at(0); it != reader.end(); ++it, ++pit) {
+      THES_ASSERT(it->coff() == pit->coff() && it->uoff() == pit->uoff());
+      THES_ASSERT(it->csize() == pit->csize() && it->usize() == pit->usize());
+    }
+  }
+
+  // A corrupt index file is rejected, even if the corrupt value is not used to build the index
+  {
+    const std::size_t off = sizeof(plazma::IndexFileHeader) + 2 * sizeof(plazma::IndexFileStream) +
+                            offsetof(plazma::IndexFileBlock, uncompressed_offset);
+    plazma::OutputFile pzi{pzi_path, plazma::OutputFile::Mode::update};
+    std::byte value{};
+    pzi.pread(std::span{&value, 1}, off);
+    const auto corrupt = value ^ std::byte{1};
+    pzi.pwrite(std::span{&corrupt, 1}, off);
+    THES_ASSERT(plazma::load_index_file(multi_path, parsed.source()) == nullptr);
+    pzi.pwrite(std::span{&value, 1}, off);
+    THES_ASSERT(plazma::load_index_file(multi_path, parsed.source()) != nullptr);
+  }
+
+  // A modified file invalidates the index file
+  std::filesystem::last_write_time(
+    multi_path, std::filesystem::last_write_time(multi_path) + std::chrono::seconds{1});
+  THES_ASSERT(plazma::load_index_file(multi_path, parsed.source()) == nullptr);
+}
@@ -4,11 +4,14 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <span>
 #include <string>
+#include <string_view>
 
 #include "thesauros/thesauros.hpp"
 
@@ -38,6 +41,75 @@ int main(int /*argc*/, const char* const* const argv) {
   THES_ASSERT(xz_reader.size() == 92172);
   THES_ASSERT(xz_reader.uncompressed_size() == 147251);
 
+  // A single decoder is reused for whole blocks and for parts of blocks.
+  {
+    plazma::Decoder decoder{};
+    thes::DynamicBuffer buf{};
+    for (auto block : xz_reader) {
+      block.decompress(decoder, buf);
+      THES_ASSERT(std::string_view(reinterpret_cast<const char*>(buf.data()), buf.size()) ==
+                  std::string_view(md_str).substr(block.uoff(), block.usize()));
+    }
+    const std::size_t begin = xz_size / 3;
+    std::string part(xz_size / 2, '\0');
+    xz_reader.load_segment(begin, std::span{part.data(), part.size()}, decoder);
+    THES_ASSERT(part == md_str.substr(begin, part.size()));
+  }
+
+  for (const auto access : {plazma::Access::sequential, plazma::Access::random}) {
+    plazma::Reader mmap_reader{xz_path, {.input = plazma::InputMode::mmap, .access = access}};
+    THES_ASSERT(mmap_reader.block_count() == xz_reader.block_count());
+    std::string mmap_str(xz_size + 1, '\0');
+    mmap_reader.load_segment(0, std::span{mmap_str.data(), xz_size});
+    THES_ASSERT(md_str == mmap_str);
+  }
+
+  // The same data from memory and from a user-defined source, which is read in small pieces.
+  {
+    thes::FileReader compressed{xz_path};
+    thes::DynamicBuffer data{};
+    compressed.pread(data, compressed.size(), 0);
+
+    plazma::Reader mem_reader{plazma::ByteSource::memory(std::span{data.data(), data.size()})};
+    THES_ASSERT(mem_reader.size() == xz_reader.size());
+    std::string mem_str(xz_size + 1, '\0');
+    mem_reader.load_segment(0, std::span{mem_str.data(), xz_size});
+    THES_ASSERT(md_str == mem_str);
+
+    struct PieceSource {
+      std::span<const std::byte> data;
+      [[nodiscard]] std::size_t size() const {
+        return data.size();
+      }
+      std::size_t try_pread(std::span<std::byte> out, std::size_t off) const {
+        const auto num = std::min<std::size_t>({out.size(), data.size() - off, 1000});
+        std::memcpy(out.data(), data.data() + off, num);
+        return num;
+      }
+    };
+    plazma::Reader custom_reader{
+      plazma::ByteSource::custom(PieceSource{std::span{data.data(), data.size()}})};
+    THES_ASSERT(custom_reader.block_count() == xz_reader.block_count());
+    std::string custom_str(xz_size + 1, '\0');
+    custom_reader.load_segment(0, std::span{custom_str.data(), xz_size});
+    THES_ASSERT(md_str == custom_str);
+  }
+
+  // Whole blocks are fetched ahead when decoding on a pool, with and without io_uring,
+  // whose reads are counted by AliceFetch.
+  for (const bool io_uring : {true, false}) {
+    const plazma::FetchParams fetch{.depth = 3, .io_uring = io_uring};
+    plazma::Reader reader{xz_path, xz_reader.index(), {.fetch = fetch}};
+    thes::FixedStdThreadPool pool(4);
+    std::string str(xz_size + 1, '\0');
+    reader.load_segment(0, std::span{str.data(), xz_size}, pool);
+    THES_ASSERT(md_str == str);
+    const std::size_t begin = xz_size / 3;
+    std::string part(xz_size / 2, '\0');
+    reader.load_segment(begin, std::span{part.data(), part.size()}, pool);
+    THES_ASSERT(part == md_str.substr(begin, part.size()));
+  }
+
   for (std::size_t thread_num = 1; thread_num <= 8; ++thread_num) {
     std::cout << thread_num << '\n';
     std::string str(xz_size + 1, '\0');
@@ -45,12 +117,31 @@ int main(int /*argc*/, const char* const* const argv) {
     thes::FixedStdThreadPool pool(thread_num);
     thes::UniformIndexSegmenter seg{xz_size, pool.thread_num()};
     pool.execute([&](const std::size_t idx) {
-      plazma::Reader reader{xz_path};
+      plazma::Reader reader{xz_path, xz_reader.index()};
       const auto iota = seg.segment_range(idx);
       const auto begin = iota.begin_value();
       reader.load_segment(begin, std::span{str.data() + begin, iota.size()});
     });
 
     THES_ASSERT(md_str == str);
+
+    std::string par_str(xz_size + 1, '\0');
+    xz_reader.load_segment(0, std::span{par_str.data(), xz_size}, pool);
+    THES_ASSERT(md_str == par_str);
+
+    // Ranges aligned to blocks, which cover the file without overlapping
+    const auto ranges = xz_reader.partition(thread_num);
+    THES_ASSERT(ranges.size() == thread_num);
+    THES_ASSERT(ranges.front().begin == 0 && ranges.back().end == xz_size);
+    for (std::size_t i = 0; i + 1 < ranges.size(); ++i) {
+      THES_ASSERT(ranges[i].end == ranges[i + 1].begin);
+      THES_ASSERT(xz_reader.iter_at(ranges[i].end)->uoff() == ranges[i].end);
+    }
+
+    std::string part_str(xz_size + 1, '\0');
+    xz_reader.execute_partitioned(pool, [&](const plazma::UncompressedRange& range) {
+      xz_reader.load_segment(range.begin, std::span{part_str.data() + range.begin, range.size()});
+    });
+    THES_ASSERT(md_str == part_str);
   }
 }
@@ -0,0 +1,72 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  static_assert(plazma::stats_enabled);
+
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice-stats.md.xz";
+
+  thes::FileReader md_reader{md_path};
+  const auto md_size = md_reader.size();
+  std::string md_str(md_size + 1, '\0');
+  md_reader.pread(std::span{md_str.data(), md_size}, 0);
+
+  plazma::WriteStats write_stats{};
+  {
+    plazma::Writer xz_writer{xz_path, {.block_size = 16384}};
+    xz_writer.write(std::span{std::as_const(md_str).data(), md_size});
+    xz_writer.finish();
+    write_stats = xz_writer.stats();
+  }
+  THES_ASSERT(write_stats.bytes_in == md_size);
+  THES_ASSERT(write_stats.bytes_out == std::filesystem::file_size(xz_path));
+  THES_ASSERT(write_stats.writes > 0);
+  // Finishing the stream waits for the threads of the encoder.
+  THES_ASSERT(write_stats.stalls > 0);
+  THES_ASSERT(plazma::global_write_stats().bytes_in == md_size);
+
+  plazma::Reader xz_reader{xz_path};
+  const std::size_t block_size = 16384;
+
+  // The whole file, which only decodes what is delivered
+  std::string xz_str(md_size + 1, '\0');
+  xz_reader.load_segment(0, std::span{xz_str.data(), md_size});
+  THES_ASSERT(md_str == xz_str);
+  {
+    const auto stats = xz_reader.stats();
+    std::cout << "preads: " << stats.pread_calls << ", code: " << stats.code_ns << "ns\n";
+    THES_ASSERT(stats.blocks_decoded == xz_reader.block_count());
+    THES_ASSERT(stats.bytes_decompressed == md_size);
+    THES_ASSERT(stats.bytes_delivered == md_size);
+    THES_ASSERT(stats.pread_bytes >= std::filesystem::file_size(xz_path) / 2);
+  }
+
+  // A range in the middle of a block, which discards the part of the block preceding it
+  std::string part(100, '\0');
+  xz_reader.load_segment(block_size + 1000, std::span{part.data(), part.size()});
+  THES_ASSERT(part == md_str.substr(block_size + 1000, part.size()));
+  {
+    const auto stats = xz_reader.stats();
+    THES_ASSERT(stats.blocks_decoded == xz_reader.block_count() + 1);
+    THES_ASSERT(stats.bytes_delivered == md_size + part.size());
+    THES_ASSERT(stats.bytes_decompressed == md_size + 1000 + part.size());
+  }
+
+  THES_ASSERT(plazma::global_read_stats().bytes_delivered == md_size + part.size());
+}
@@ -0,0 +1,99 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <span>
+#include <string>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto md_path = base_path / "alice.md";
+  const auto xz_path = base_path / "alice.md.xz";
+
+  thes::FileReader md_reader{md_path};
+  const auto md_size = md_reader.size();
+  std::string md_str(md_size + 1, '\0');
+  md_reader.pread(std::span{md_str.data(), md_size}, 0);
+
+  plazma::Reader xz_reader{xz_path};
+  std::size_t block_num = 0;
+  for (auto it = xz_reader.begin(); it != xz_reader.end(); ++it) {
+    THES_ASSERT(it->usize() > 0);
+    ++block_num;
+  }
+  THES_ASSERT(block_num == xz_reader.block_count());
+
+  for (std::size_t thread_num = 1; thread_num <= 8; ++thread_num) {
+    for (std::size_t window = 1; window <= 2 * thread_num; window += thread_num) {
+      std::string str(md_size + 1, '\0');
+      std::size_t off = 0;
+      std::size_t num = 0;
+
+      plazma::BlockStream stream{xz_reader, {.thread_num = thread_num, .window = window}};
+      while (auto block = stream.next()) {
+        THES_ASSERT(block->uoff() == off);
+        std::memcpy(str.data() + off, block->data().data(), block->data().size());
+        off += block->data().size();
+        ++num;
+      }
+      THES_ASSERT(!stream.next().has_value());
+
+      std::cout << thread_num << "/" << window << ": " << num << " blocks\n";
+      THES_ASSERT(num == xz_reader.block_count());
+      THES_ASSERT(md_str == str);
+    }
+  }
+
+  // Only the blocks overlapping a range
+  {
+    const std::size_t begin = 10000;
+    const std::size_t end = 20000;
+    plazma::BlockStream stream{xz_reader, {.thread_num = 4, .begin = begin, .end = end}};
+    std::size_t first = md_size;
+    std::size_t last = 0;
+    while (auto block = stream.next()) {
+      THES_ASSERT(block->uoff() < end && block->uoff() + block->data().size() > begin);
+      first = std::min<std::size_t>(first, block->uoff());
+      last = std::max<std::size_t>(last, block->uoff() + block->data().size());
+    }
+    THES_ASSERT(first <= begin && last >= end);
+
+    plazma::BlockStream empty{xz_reader, {.begin = md_size}};
+    THES_ASSERT(!empty.next().has_value());
+  }
+
+  // Holding all blocks of the window
+  {
+    plazma::BlockStream stream{xz_reader, {.thread_num = 2, .window = 2}};
+    auto first = stream.next();
+    auto second = stream.next();
+    THES_ASSERT(first.has_value() && second.has_value());
+    bool failed = false;
+    try {
+      THES_ASSERT(!stream.next().has_value());
+    } catch (const plazma::Exception& /*e*/) {
+      failed = true;
+    }
+    THES_ASSERT(failed);
+    first.reset();
+    auto third = stream.next();
+    THES_ASSERT(third.has_value() && third->uoff() == second->uoff() + second->data().size());
+  }
+
+  // Stopping early
+  {
+    plazma::BlockStream stream{xz_reader, {.thread_num = 4}};
+    THES_ASSERT(stream.next().has_value());
+  }
+}
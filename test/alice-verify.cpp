@@ -0,0 +1,68 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <span>
+
+#include "thesauros/thesauros.hpp"
+
+#include "plazma/plazma.hpp"
+
+int main(int /*argc*/, const char* const* const argv) {
+  const auto base_path = std::filesystem::canonical(std::filesystem::path{argv[0]}.parent_path());
+  const auto xz_path = base_path / "alice.md.xz";
+
+  thes::FixedStdThreadPool pool(4);
+
+  plazma::Reader xz_reader{xz_path};
+  const auto report = xz_reader.verify(pool);
+  THES_ASSERT(report.ok());
+  THES_ASSERT(report.block_count == xz_reader.block_count());
+  THES_ASSERT(report.verified_size == xz_reader.uncompressed_size());
+
+  // Flip a byte in the middle of two blocks, which are reported without stopping the verification
+  thes::DynamicBuffer data{};
+  {
+    thes::FileReader reader{xz_path};
+    reader.pread(data, reader.size(), 0);
+  }
+  std::size_t corrupt_usize = 0;
+  for (auto block : xz_reader) {
+    const auto idx = block.raw().block.number_in_file - 1;
+    if (idx == 10 || idx == 100) {
+      data[block.coff() + block.csize() / 2] ^= std::byte{0x55};
+      corrupt_usize += block.usize();
+    }
+  }
+
+  plazma::Reader corrupt_reader{plazma::ByteSource::memory(std::span{data.data(), data.size()})};
+  const auto corrupt_report = corrupt_reader.verify(pool);
+  for (const auto& block : corrupt_report.corrupt_blocks) {
+    std::cout << block.index << " at " << block.coff << ": " << block.error << '\n';
+  }
+  THES_ASSERT(!corrupt_report.ok());
+  THES_ASSERT(corrupt_report.index_errors.empty());
+  THES_ASSERT(corrupt_report.corrupt_blocks.size() == 2);
+  THES_ASSERT(corrupt_report.corrupt_blocks[0].index == 10);
+  THES_ASSERT(corrupt_report.corrupt_blocks[1].index == 100);
+  THES_ASSERT(corrupt_report.verified_size == xz_reader.uncompressed_size() - corrupt_usize);
+
+  // Errors which are not caused by the data stop the verification instead of being reported
+  {
+    plazma::Reader budget_reader{xz_path, {.budget = std::make_shared<plazma::MemoryBudget>(1)}};
+    bool failed = false;
+    try {
+      (void)budget_reader.verify(pool);
+    } catch (const plazma::Exception& e) {
+      THES_ASSERT(dynamic_cast<const plazma::DataError*>(&e) == nullptr);
+      failed = true;
+    }
+    THES_ASSERT(failed);
+  }
+}
@@ -4,6 +4,8 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
+#include <algorithm>
+#include <cstddef>
 #include <filesystem>
 #include <iostream>
 #include <span>
@@ -38,4 +40,83 @@ int main(int /*argc*/, const char* const* const argv) {
   THES_ASSERT(md_str == xz_str);
   THES_ASSERT(xz_reader.size() == 45704);
   THES_ASSERT(xz_reader.uncompressed_size() == 147251);
+
+  // Write in chunks through a type-erased sink, with a flush in between
+  const auto chunked_path = base_path / "alice-chunked.md.xz";
+  {
+    plazma::Writer xz_writer{chunked_path};
+    const plazma::SinkRef sink{xz_writer};
+    const auto* data = reinterpret_cast<const std::byte*>(md_str.data());
+    for (std::size_t off = 0; off < md_size; off += 1000) {
+      sink.write(std::span{data + off, std::min<std::size_t>(1000, md_size - off)});
+      if (off == 50000) {
+        xz_writer.flush();
+      }
+    }
+    sink.finish();
+  }
+  {
+    plazma::Reader reader{chunked_path};
+    std::cout << "chunked block count: " << reader.block_count() << '\n';
+    THES_ASSERT(reader.block_count() == 2);
+    std::string str(md_size + 1, '\0');
+    reader.load_segment(0, std::span{str.data(), reader.uncompressed_size()});
+    THES_ASSERT(md_str == str);
+  }
+
+  // Reblock a single block which is larger than the chunks passed on by the decoder
+  const auto single_path = base_path / "alice-single.md.xz";
+  const auto reblocked_path = base_path / "alice-reblocked.md.xz";
+  std::string big_str{};
+  for (std::size_t i = 0; i < 20; ++i) {
+    big_str.append(md_str.data(), md_size);
+  }
+  {
+    plazma::Writer xz_writer{single_path};
+    xz_writer.write(std::span{std::as_const(big_str).data(), big_str.size()});
+  }
+  THES_ASSERT(plazma::Reader{single_path}.block_count() == 1);
+  plazma::reblock(single_path, reblocked_path, {.block_size = 1U << 20});
+  {
+    plazma::Reader reader{reblocked_path};
+    std::cout << "reblocked block count: " << reader.block_count() << '\n';
+    THES_ASSERT(reader.block_count() == (big_str.size() + (1U << 20) - 1) / (1U << 20));
+    std::string str(big_str.size(), '\0');
+    reader.load_segment(0, std::span{str.data(), str.size()});
+    THES_ASSERT(big_str == str);
+  }
+
+  // Split blocks when writing in odd-sized chunks, which do not line up with the boundaries
+  const auto split_path = base_path / "alice-split.md.xz";
+  const auto write_split = [&](plazma::BlockSplit split) {
+    plazma::Writer xz_writer{split_path, {.block_size = 4099, .split = std::move(split)}};
+    for (std::size_t off = 0; off < md_size; off += 777) {
+      xz_writer.write(std::span{md_str.data() + off, std::min<std::size_t>(777, md_size - off)});
+    }
+  };
+  const auto check_split = [&](auto&& check_block) {
+    plazma::Reader reader{split_path};
+    THES_ASSERT(reader.block_count() > 1);
+    for (auto it = reader.iter_at(0); it != reader.end(); ++it) {
+      if (it->uend() != md_size) {
+        check_block(*it);
+      }
+    }
+    std::string str(md_size + 1, '\0');
+    reader.load_segment(0, std::span{str.data(), md_size});
+    THES_ASSERT(md_str == str);
+  };
+
+  // Blocks end after the first newline following the block size, up to the maximum block size
+  write_split(plazma::BlockSplit::after(std::byte{'\n'}));
+  check_split([&](plazma::Block block) {
+    THES_ASSERT(block.usize() >= 4099 && block.usize() <= 2 * 4099);
+    THES_ASSERT(md_str[block.uend() - 1] == '\n');
+  });
+  // Blocks end at multiples of the element size, i.e. within the block size
+  write_split(plazma::BlockSplit::aligned<thes::u64>());
+  check_split([&](plazma::Block block) {
+    THES_ASSERT(block.usize() <= 4099);
+    THES_ASSERT(block.uend() % sizeof(thes::u64) == 0);
+  });
 }
@@ -4,29 +4,136 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at https://mozilla.org/MPL/2.0/.
 
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
 #include <iostream>
+#include <optional>
 #include <span>
+#include <string_view>
 
 #include "thesauros/containers.hpp"
+#include "thesauros/format.hpp"
 #include "thesauros/io.hpp"
+#include "thesauros/types.hpp"
 
+#include "plazma/decode.hpp"
 #include "plazma/encode.hpp"
 
+#include "parse.hpp"
+
+namespace {
+// The size of the chunks in which the input is passed to the encoder, which bounds the memory
+// used by this tool in addition to that of the encoder.
+constexpr std::size_t read_chunk_size = std::size_t{1} << 20;
+
+// Passes the input to the writer in chunks, returning the number of bytes read.
+thes::u64 compress_file(thes::FileReader& reader, plazma::Writer& writer) {
+  thes::DynamicBuffer chunk{};
+  thes::u64 off = 0;
+  while (true) {
+    const auto num = reader.try_pread(chunk, read_chunk_size, static_cast<long>(off));
+    if (num == 0) {
+      return off;
+    }
+    writer.write(std::span{chunk.data(), num});
+    off += num;
+  }
+}
+thes::u64 compress_stdin(plazma::Writer& writer) {
+  thes::DynamicBuffer chunk{};
+  chunk.resize(read_chunk_size);
+  thes::u64 size = 0;
+  while (true) {
+    const auto num = std::fread(chunk.data(), 1, chunk.size(), stdin);
+    if (num > 0) {
+      writer.write(std::span{chunk.data(), num});
+      size += num;
+    }
+    if (num < chunk.size()) {
+      if (std::ferror(stdin) != 0) {
+        throw plazma::Exception("Reading from stdin failed!");
+      }
+      return size;
+    }
+  }
+}
+} // namespace
+
 int main(int argc, const char* const* const argv) {
-  if (argc != 3) {
-    std::cerr << "Usage: " << argv[0] << " <in_file> <out_file>\n";
-    return 1;
+  const auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " <in_file|-> <out_file> [--preset <0-9>] [--block-size <bytes>]"
+                 " [--threads <n>] [--index] [--append]\n";
+    return EXIT_FAILURE;
+  };
+  if (argc < 3) {
+    return usage();
   }
+  const std::string_view src{argv[1]};
+  const std::string_view dst{argv[2]};
 
-  thes::DynamicBuffer contents{};
-  {
-    thes::FileReader in_reader{argv[1]};
-    in_reader.pread(contents, in_reader.size(), 0);
+  std::optional<thes::u32> preset{};
+  std::optional<thes::u64> block_size{};
+  std::optional<thes::u32> thread_num{};
+  bool index_file = false;
+  bool append = false;
+  for (int i = 3; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (arg == "--index") {
+      index_file = true;
+      continue;
+    }
+    if (arg == "--append") {
+      append = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      return usage();
+    }
+    const std::string_view value{argv[++i]};
+    if (arg == "--preset") {
+      preset = plazma::tools::parse_number<thes::u32>(value);
+      if (!preset.has_value() || *preset > 9) {
+        return usage();
+      }
+    } else if (arg == "--block-size") {
+      block_size = plazma::tools::parse_number<thes::u64>(value);
+      if (!block_size.has_value() || *block_size == 0) {
+        return usage();
+      }
+    } else if (arg == "--threads") {
+      thread_num = plazma::tools::parse_number<thes::u32>(value);
+      if (!thread_num.has_value() || *thread_num == 0) {
+        return usage();
+      }
+    } else {
+      return usage();
+    }
   }
-  std::cout << "size: " << contents.size() << '\n';
 
-  {
-    plazma::Writer xz_writer{argv[2]};
-    xz_writer.write(std::span{contents.data(), contents.size()});
+  try {
+    thes::u64 size = 0;
+    {
+      plazma::Writer xz_writer{
+        dst,
+        {.preset = preset, .block_size = block_size, .thread_num = thread_num, .append = append}};
+      if (src == "-") {
+        size = compress_stdin(xz_writer);
+      } else {
+        thes::FileReader in_reader{src};
+        size = compress_file(in_reader, xz_writer);
+      }
+      xz_writer.finish();
+    }
+    std::cout << "size: " << size << '\n';
+
+    if (index_file) {
+      plazma::create_index_file(dst);
+    }
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "{}\n", e.what());
+    return EXIT_FAILURE;
   }
 }
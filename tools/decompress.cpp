@@ -0,0 +1,170 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <lzma.h>
+
+#include "thesauros/containers.hpp"
+#include "thesauros/format.hpp"
+#include "thesauros/multithreading.hpp"
+
+#include "plazma/decode.hpp"
+
+#include "parse.hpp"
+
+namespace {
+[[noreturn]] void throw_errno(std::string_view action, const std::filesystem::path& path) {
+  throw plazma::Exception(
+    fmt::format("{} {} failed: {}", action, path.string(), std::strerror(errno)));
+}
+
+// Writes the whole buffer at the given offset, retrying after partial writes.
+void pwrite_all(int fd, std::span<const std::byte> data, std::size_t off) {
+  while (!data.empty()) {
+    const auto ret = ::pwrite(fd, data.data(), data.size(), static_cast<off_t>(off));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw plazma::Exception(fmt::format("Writing failed: {}", std::strerror(errno)));
+    }
+    data = data.subspan(static_cast<std::size_t>(ret));
+    off += static_cast<std::size_t>(ret);
+  }
+}
+
+// Decodes the blocks overlapping [begin, end) on all threads, each of which writes its blocks
+// into the preallocated output file at their positions.
+void decompress_to_file(plazma::Reader& reader, const std::filesystem::path& dst,
+                        std::size_t begin, std::size_t end, std::size_t thread_num) {
+  const int fd = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    throw_errno("Opening", dst);
+  }
+  try {
+    if (::ftruncate(fd, static_cast<off_t>(end - begin)) == -1) {
+      throw_errno("Resizing", dst);
+    }
+
+    std::vector<lzma_index_iter> blocks{};
+    if (begin < end) {
+      for (auto it = reader.iter_at(begin); it != reader.end() && it->uoff() < end; ++it) {
+        blocks.push_back(it.raw());
+      }
+    }
+
+    thes::FixedStdThreadPool pool(thread_num);
+    reader.decode_blocks(pool, blocks, [&](plazma::Block block, plazma::Decoder& decoder) {
+      const auto common_begin = std::max<std::size_t>(begin, block.uoff());
+      const auto common_end = std::min<std::size_t>(end, block.uend());
+      thes::DynamicBuffer& buf = decoder.output();
+      buf.resize(common_end - common_begin);
+      block.decompress(decoder, common_begin - block.uoff(), std::span{buf.data(), buf.size()});
+      pwrite_all(fd, std::span{buf.data(), buf.size()}, common_begin - begin);
+    });
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  if (::close(fd) == -1) {
+    throw_errno("Closing", dst);
+  }
+}
+
+// Decodes the blocks overlapping [begin, end) on background threads and writes them to stdout in
+// order, with at most `window` blocks decoded ahead of the output.
+void decompress_to_stdout(plazma::Reader& reader, std::size_t begin, std::size_t end,
+                          std::size_t thread_num, std::optional<std::size_t> window) {
+  plazma::BlockStream stream{
+    reader, {.thread_num = thread_num, .window = window, .begin = begin, .end = end}};
+  while (auto block = stream.next()) {
+    const auto data = block->data();
+    const auto common_begin = std::max<std::size_t>(begin, block->uoff());
+    const auto common_end = std::min<std::size_t>(end, block->uoff() + data.size());
+    const auto part = data.subspan(common_begin - block->uoff(), common_end - common_begin);
+    if (std::fwrite(part.data(), 1, part.size(), stdout) != part.size()) {
+      throw plazma::Exception("Writing to stdout failed!");
+    }
+  }
+  if (std::fflush(stdout) != 0) {
+    throw plazma::Exception("Writing to stdout failed!");
+  }
+}
+} // namespace
+
+int main(int argc, const char* const* const argv) {
+  const auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " <in_file> <out_file|-> [--threads <n>] [--offset <bytes>] [--length <bytes>]"
+                 " [--window <blocks>]\n";
+    return EXIT_FAILURE;
+  };
+  if (argc < 3) {
+    return usage();
+  }
+  const std::filesystem::path src{argv[1]};
+  const std::string_view dst{argv[2]};
+
+  std::size_t thread_num = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  std::size_t offset = 0;
+  std::optional<std::size_t> length{};
+  std::optional<std::size_t> window{};
+  for (int i = 3; i < argc; i += 2) {
+    const std::string_view arg{argv[i]};
+    const auto value =
+      i + 1 < argc ? plazma::tools::parse_number<std::size_t>(argv[i + 1]) : std::nullopt;
+    if (!value.has_value()) {
+      return usage();
+    }
+    if (arg == "--threads" && *value > 0) {
+      thread_num = *value;
+    } else if (arg == "--offset") {
+      offset = *value;
+    } else if (arg == "--length") {
+      length = *value;
+    } else if (arg == "--window" && *value > 0) {
+      window = *value;
+    } else {
+      return usage();
+    }
+  }
+
+  try {
+    plazma::Reader reader{src};
+    const std::size_t size = reader.uncompressed_size();
+    if (offset > size) {
+      fmt::print(stderr, "The offset {} exceeds the uncompressed size {}!\n", offset, size);
+      return EXIT_FAILURE;
+    }
+    const std::size_t end = offset + std::min(length.value_or(size - offset), size - offset);
+
+    if (dst == "-") {
+      decompress_to_stdout(reader, offset, end, thread_num, window);
+    } else {
+      decompress_to_file(reader, dst, offset, end, thread_num);
+    }
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "{}\n", e.what());
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,28 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#ifndef TOOLS_PARSE_HPP
+#define TOOLS_PARSE_HPP
+
+#include <charconv>
+#include <optional>
+#include <string_view>
+#include <system_error>
+
+namespace plazma::tools {
+// Parses a command-line argument which has to consist of a number only.
+template<typename T>
+inline std::optional<T> parse_number(std::string_view str) {
+  T value{};
+  const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (ec != std::errc{} || ptr != str.data() + str.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+} // namespace plazma::tools
+
+#endif // TOOLS_PARSE_HPP
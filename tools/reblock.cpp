@@ -0,0 +1,82 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+#include "thesauros/format.hpp"
+#include "thesauros/types.hpp"
+
+#include "plazma/reblock.hpp"
+
+#include "parse.hpp"
+
+int main(int argc, const char* const* const argv) {
+  const auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " <in_file> <out_file> [--block-size <bytes>] [--preset <0-9>] [--threads <n>]"
+                 " [--index]\n";
+    return EXIT_FAILURE;
+  };
+  if (argc < 3) {
+    return usage();
+  }
+  const std::filesystem::path src{argv[1]};
+  const std::filesystem::path dst{argv[2]};
+
+  // Small blocks allow segments to be loaded with little overhead.
+  thes::u64 block_size = thes::u64{1} << 20;
+  std::optional<thes::u32> preset{};
+  std::optional<thes::u32> thread_num{};
+  bool index_file = false;
+  for (int i = 3; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (arg == "--index") {
+      index_file = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      return usage();
+    }
+    const std::string_view value{argv[++i]};
+    if (arg == "--block-size") {
+      const auto parsed = plazma::tools::parse_number<thes::u64>(value);
+      if (!parsed.has_value() || *parsed == 0) {
+        return usage();
+      }
+      block_size = *parsed;
+    } else if (arg == "--preset") {
+      preset = plazma::tools::parse_number<thes::u32>(value);
+      if (!preset.has_value() || *preset > 9) {
+        return usage();
+      }
+    } else if (arg == "--threads") {
+      thread_num = plazma::tools::parse_number<thes::u32>(value);
+      if (!thread_num.has_value() || *thread_num == 0) {
+        return usage();
+      }
+    } else {
+      return usage();
+    }
+  }
+
+  try {
+    plazma::reblock(src, dst,
+                    {.preset = preset, .block_size = block_size, .thread_num = thread_num});
+    if (index_file) {
+      plazma::create_index_file(dst);
+    }
+    plazma::Reader reader{dst};
+    std::cout << "block count: " << reader.block_count() << '\n';
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "{}\n", e.what());
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,63 @@
+// This file is part of https://github.com/KurtBoehm/plazma.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <thread>
+
+#include "thesauros/format.hpp"
+#include "thesauros/multithreading.hpp"
+
+#include "plazma/decode.hpp"
+
+#include "parse.hpp"
+
+int main(int argc, const char* const* const argv) {
+  const auto usage = [&] {
+    std::cerr << "Usage: " << argv[0] << " <in_file> [--threads <n>]\n";
+    return EXIT_FAILURE;
+  };
+  if (argc != 2 && argc != 4) {
+    return usage();
+  }
+  const std::filesystem::path src{argv[1]};
+
+  std::size_t thread_num = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  if (argc == 4) {
+    const auto value = plazma::tools::parse_number<std::size_t>(argv[3]);
+    if (std::string_view{argv[2]} != "--threads" || !value.has_value() || *value == 0) {
+      return usage();
+    }
+    thread_num = *value;
+  }
+
+  try {
+    plazma::Reader reader{src};
+    thes::FixedStdThreadPool pool(thread_num);
+    const auto report = reader.verify(pool);
+
+    for (const auto& error : report.index_errors) {
+      fmt::print("{}\n", error);
+    }
+    for (const auto& block : report.corrupt_blocks) {
+      fmt::print("block {} (compressed offset {}, uncompressed offset {}): {}\n", block.index,
+                 block.coff, block.uoff, block.error);
+    }
+    fmt::print("{} of {} blocks intact, {} of {} bytes verified\n",
+               report.block_count - report.corrupt_blocks.size(), report.block_count,
+               report.verified_size, reader.uncompressed_size());
+    return report.ok() ? EXIT_SUCCESS : EXIT_FAILURE;
+  } catch (const std::exception& e) {
+    fmt::print(stderr, "{}\n", e.what());
+    return EXIT_FAILURE;
+  }
+}